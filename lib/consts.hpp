@@ -5,4 +5,9 @@ using namespace eosio;
 
 const name LOG_REC = name("dsautonomous");
 const name GUIDE_CONTRACT = name("dsguideguide");
-const name SWAP_CONTRACT = name("dsswapdsswap");
\ No newline at end of file
+const name SWAP_CONTRACT = name("dsswapdsswap");
+
+// trade mining epoch length in seconds,epoch = now / TRADE_EPOCH_SECS
+const uint32_t TRADE_EPOCH_SECS = 86400;
+// trade volumes of an epoch can be claimed for TRADE_CLAIM_EPOCHS epochs after it ended,then dsswap prunes them
+const uint64_t TRADE_CLAIM_EPOCHS = 30;
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "assets.hpp"
+#include "auths.hpp"
+#include "safemath.hpp"
+#include "structs.hpp"
+#include <math.h>
+#include <optional>
+
+using namespace std;
+using namespace eosio;
+
+#define CODE_10000 "invalid max_quantity value"
+#define CODE_10001 "ins can not be empty"
+#define CODE_10002 "invalid rate value"
+#define CODE_10003 "token exists already"
+#define CODE_10004 "exchange in data does not exist"
+#define CODE_10005 "config does not exists; initialization is required"
+#define CODE_10006 "config has initialized"
+#define CODE_10007 "overdrawn balance"
+
+// Converter engine shared by the plugins that exchange accepted tokens(`exchangein`) for the org token.
+// The OUT action is a compile-time payout policy,e.g. `converter::engine<converter::mint_payout>`.
+namespace converter {
+
+// singleton
+// remaining_quantity is the value at init(or before dscounter existed),the live one is in dscounter
+TABLE dsconf {
+    name token;
+    bool limit;
+    asset max_quantity;
+    asset remaining_quantity;
+    name org_contract;
+};
+
+// singleton
+// written by limited conversions instead of rewriting the whole dsconf,
+// created on the first one from dsconf.remaining_quantity
+TABLE dscounter {
+    asset remaining_quantity;
+};
+
+// scope is self
+TABLE exchange_in {
+    name token;
+    symbol_code symbol_code;
+    uint64_t rate; //BASE_SCALE
+
+    uint64_t primary_key() const { return token.value; }
+};
+
+using dsconf_idx = singleton<"dsconf"_n, dsconf>;
+using counter_idx = singleton<"dscounter"_n, dscounter>;
+using exin_idx = multi_index<"exchangein"_n, exchange_in>;
+
+//0.0 = 0
+//0.01 = 10^10
+//0.10 = 10^11
+//1.00 = 10^12
+//10.0 = 10^13
+//...
+const uint64_t BASE_SCALE = 1000000000000; //10^12
+
+// the plugin mints the org token,it has to be the token issuer
+struct mint_payout {
+    static void send(const name& self, const dsconf& conf, const name& to, const asset& out, const string& memo) {
+        action(permission_level { self, name("active") },
+               conf.token, name("mint"),
+               std::make_tuple(self, to, out, memo))
+            .send();
+    }
+};
+
+// the org contract transfers the org token on behalf of the plugin
+struct approvetrx_payout {
+    static void send(const name& self, const dsconf& conf, const name& to, const asset& out, const string& memo) {
+        action(permission_level { self, name("active") },
+               conf.org_contract, name("approvetrx"),
+               std::make_tuple(self, conf.token, to, out, memo))
+            .send();
+    }
+};
+
+template <typename Payout>
+class engine {
+public:
+    engine(const name& self)
+        : self(self) { }
+
+    void check_perm(const name& act, const name& caller) {
+        auto auth = auths();
+        auth.check_perm(get_config().org_contract, self, act, caller);
+    }
+
+    // read once per action
+    const dsconf& get_config() {
+        if (!conf_cache) {
+            dsconf_idx dt(self, self.value);
+            check(dt.exists(), CODE_10005);
+            conf_cache = dt.get();
+        }
+        return *conf_cache;
+    }
+
+    // read once per action
+    const dscounter& get_counter() {
+        if (!counter_cache) {
+            counter_idx ct(self, self.value);
+            counter_cache = ct.exists() ? ct.get() : dscounter { .remaining_quantity = get_config().remaining_quantity };
+        }
+        return *counter_cache;
+    }
+
+    void save_conf(const name& token,
+                   const bool& limit,
+                   const asset& max_quantity,
+                   const name& org_contract,
+                   const bool& is_init) {
+        dsconf_idx dt(self, self.value);
+
+        if (is_init)
+            check(!dt.exists(), CODE_10006);
+        else
+            check(dt.exists(), CODE_10005);
+
+        auto a = assets();
+        auto stat = a.get_stats(token, max_quantity.symbol);
+        check(stat.supply.symbol == max_quantity.symbol, CODE_10000);
+
+        if (limit) {
+            check(max_quantity.amount > 0, CODE_10000);
+        }
+
+        dsconf conf_slt;
+        if (!is_init) {
+            conf_slt = dt.get();
+            conf_slt.token = token;
+            conf_slt.limit = limit;
+            conf_slt.max_quantity = max_quantity;
+        } else {
+            conf_slt.token = token;
+            conf_slt.limit = limit;
+            conf_slt.max_quantity = max_quantity;
+            conf_slt.remaining_quantity = limit ? max_quantity : asset(0, max_quantity.symbol);
+            conf_slt.org_contract = org_contract;
+        }
+
+        dt.set(conf_slt, self);
+        conf_cache = conf_slt;
+    }
+
+    void init_exins(const vector<exchange_in>& ins, const symbol& out_symbol) {
+        exin_idx et(self, self.value);
+        check(et.begin() == et.end(), CODE_10006);
+        check(ins.size() > 0, CODE_10001);
+
+        const uint64_t precision_scale = _precision_scale(out_symbol);
+        for (auto const& r : ins) {
+            check(r.rate >= precision_scale, CODE_10002);
+            et.emplace(self, [&](auto& m) {
+                m = r;
+            });
+        }
+    }
+
+    void add_exin(const name& token, const symbol_code& symbol_code, const uint64_t& rate) {
+        exin_idx et(self, self.value);
+        check(et.find(token.value) == et.end(), CODE_10003);
+        check(rate >= _precision_scale(get_config().max_quantity.symbol), CODE_10002);
+
+        et.emplace(self, [&](auto& m) {
+            m.token = token;
+            m.symbol_code = symbol_code;
+            m.rate = rate;
+        });
+    }
+
+    void rm_exin(const name& token) {
+        exin_idx et(self, self.value);
+        auto itr = et.find(token.value);
+        check(itr != et.end(), CODE_10004);
+        et.erase(itr);
+    }
+
+    // whether `quantity` from `contract` is accepted,the row is copied to `in`
+    bool find_exin(const name& contract, const asset& quantity, exchange_in& in) {
+        exin_idx et(self, self.value);
+        auto itr = et.find(contract.value);
+        if (itr == et.end() || quantity.symbol.code() != itr->symbol_code)
+            return false;
+        in = *itr;
+        return true;
+    }
+
+    // amount * rate / BASE_SCALE,truncated
+    static int64_t rate_out(const int64_t& amount, const uint64_t& rate) {
+        uint128_t out = safemath::mul128(amount, rate) / BASE_SCALE;
+        check(out <= asset::max_amount, "math mul overflow");
+        return out;
+    }
+
+    // take `out` from the remaining quantity when the output is limited
+    void reserve(const dsconf& conf, const asset& out) {
+        if (!conf.limit)
+            return;
+
+        dscounter counter = get_counter();
+        check(counter.remaining_quantity.amount >= out.amount, CODE_10007);
+        counter.remaining_quantity -= out;
+
+        counter_idx ct(self, self.value);
+        ct.set(counter, self);
+        counter_cache = counter;
+    }
+
+    // IN: forward the accepted token to the org contract
+    void forward(const dsconf& conf, const name& contract, const asset& quantity, const string& memo) {
+        action(permission_level { self, name("active") },
+               contract, name("transfer"),
+               std::make_tuple(self, conf.org_contract, quantity, memo))
+            .send();
+    }
+
+    // OUT
+    void payout(const dsconf& conf, const name& to, const asset& out, const string& memo) {
+        Payout::send(self, conf, to, out, memo);
+    }
+
+    // the plain conversion: reserve,forward and pay out
+    void exchange(const dsconf& conf, const name& contract, const structs::trx_tb& tx, const asset& out) {
+        reserve(conf, out);
+        forward(conf, contract, tx.quantity, tx.memo);
+        payout(conf, tx.from, out, tx.memo);
+    }
+
+private:
+    name self;
+    std::optional<dsconf> conf_cache;
+    std::optional<dscounter> counter_cache;
+
+    static uint64_t _precision_scale(const symbol& sym) {
+        return pow(10, safemath::sub(12, sym.precision()));
+    }
+};
+
+} // namespace converter
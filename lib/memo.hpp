@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <eosio/asset.hpp>
+#include <eosio/eosio.hpp>
+#include <string_view>
+using namespace std;
+using namespace eosio;
+
+// Memo parsing without allocations: values are views into the memo and
+// the typed accessors return false instead of failing the transaction.
+namespace memo {
+
+const size_t MAX_FIELDS = 16;
+
+// split `s` by `sep` into `parts`,false when there are more than N parts
+template <size_t N>
+bool split(const string_view& s, const char& sep, array<string_view, N>& parts, size_t& count) {
+    count = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= s.size(); i++) {
+        if (i < s.size() && s[i] != sep)
+            continue;
+        if (count == N)
+            return false;
+        parts[count++] = s.substr(start, i - start);
+        start = i + 1;
+    }
+    return true;
+}
+
+// decimal digits only
+bool parse_u64(const string_view& s, uint64_t& value) {
+    if (s.empty())
+        return false;
+
+    value = 0;
+    for (const char c : s) {
+        if (c < '0' || c > '9')
+            return false;
+        const uint64_t digit = c - '0';
+        if (value > (UINT64_MAX - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+bool parse_name(const string_view& s, name& value) {
+    if (s.empty() || s.size() > 13)
+        return false;
+
+    for (size_t i = 0; i < s.size(); i++) {
+        const char c = s[i];
+        const char last = i == 12 ? 'j' : 'z';
+        if (!(c == '.' || (c >= '1' && c <= '5') || (c >= 'a' && c <= last)))
+            return false;
+    }
+    value = name(s);
+    return true;
+}
+
+bool parse_symbol_code(const string_view& s, symbol_code& value) {
+    if (s.empty() || s.size() > 7)
+        return false;
+
+    for (const char c : s) {
+        if (c < 'A' || c > 'Z')
+            return false;
+    }
+    value = symbol_code(s);
+    return true;
+}
+
+// `amount SYMBOL`, e.g. 1.0000 EOS
+bool parse_asset(const string_view& s, asset& value) {
+    const size_t space = s.find(' ');
+    if (space == string_view::npos)
+        return false;
+
+    int64_t amount = 0;
+    uint8_t precision = 0;
+    bool has_digit = false;
+    bool has_dot = false;
+    for (size_t i = 0; i < space; i++) {
+        const char c = s[i];
+        if (c == '.') {
+            if (has_dot || !has_digit)
+                return false;
+            has_dot = true;
+            continue;
+        }
+        if (c < '0' || c > '9' || amount > (asset::max_amount - (c - '0')) / 10)
+            return false;
+        amount = amount * 10 + (c - '0');
+        has_digit = true;
+        if (has_dot)
+            precision++;
+    }
+    if (!has_digit || precision > 18)
+        return false;
+
+    symbol_code code;
+    if (!parse_symbol_code(s.substr(space + 1), code))
+        return false;
+
+    value = asset(amount, symbol(code, precision));
+    return true;
+}
+
+// `key:value` fields split by `sep`,parsed once in a single pass
+class fields {
+public:
+    fields(const string_view& memo, const char& sep = ',', const char& kv_sep = ':') {
+        array<string_view, MAX_FIELDS> parts;
+        valid = split(memo, sep, parts, count);
+        const size_t n = count;
+        count = 0;
+        for (size_t i = 0; valid && i < n; i++) {
+            // tolerate a trailing or doubled separator
+            if (parts[i].empty())
+                continue;
+            const size_t pos = parts[i].find(kv_sep);
+            valid = pos != string_view::npos;
+            if (valid) {
+                keys[count] = parts[i].substr(0, pos);
+                values[count] = parts[i].substr(pos + 1);
+                count++;
+            }
+        }
+    }
+
+    bool ok() const { return valid; }
+
+    bool get(const string_view& key, string_view& value) const {
+        for (size_t i = 0; valid && i < count; i++) {
+            if (keys[i] == key) {
+                value = values[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool get_u64(const string_view& key, uint64_t& value) const {
+        string_view v;
+        return get(key, v) && parse_u64(v, value);
+    }
+
+    bool get_name(const string_view& key, name& value) const {
+        string_view v;
+        return get(key, v) && parse_name(v, value);
+    }
+
+    bool get_symbol_code(const string_view& key, symbol_code& value) const {
+        string_view v;
+        return get(key, v) && parse_symbol_code(v, value);
+    }
+
+private:
+    array<string_view, MAX_FIELDS> keys;
+    array<string_view, MAX_FIELDS> values;
+    size_t count = 0;
+    bool valid = false;
+};
+
+} // namespace memo
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <eosio/crypto.hpp>
+#include <eosio/eosio.hpp>
+#include <vector>
+using namespace std;
+using namespace eosio;
+
+namespace merkle {
+
+// parent = sha256(min(a, b) + max(a, b)),so a proof does not need left/right flags
+checksum256 hash_pair(const checksum256& a, const checksum256& b) {
+    const auto& lo = a < b ? a : b;
+    const auto& hi = a < b ? b : a;
+
+    array<uint8_t, 64> buf;
+    auto lo_bytes = lo.extract_as_byte_array();
+    auto hi_bytes = hi.extract_as_byte_array();
+    std::copy(lo_bytes.begin(), lo_bytes.end(), buf.begin());
+    std::copy(hi_bytes.begin(), hi_bytes.end(), buf.begin() + 32);
+    return sha256(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+template <typename T>
+checksum256 leaf(const T& data) {
+    auto packed = pack(data);
+    return sha256(packed.data(), packed.size());
+}
+
+bool verify(const checksum256& root, const checksum256& leaf, const vector<checksum256>& proof) {
+    checksum256 node = leaf;
+    for (auto const& sibling : proof) {
+        node = hash_pair(node, sibling);
+    }
+    return node == root;
+}
+
+}
@@ -33,4 +33,33 @@ uint64_t div(const uint64_t& a, const uint64_t& b) {
     return c;
 }
 
+uint128_t add128(const uint128_t& a, const uint128_t& b) {
+    uint128_t c = a + b;
+    check(c >= a, "math add overflow");
+    return c;
+}
+
+uint128_t mul128(const uint128_t& a, const uint128_t& b) {
+    if (a == 0)
+        return 0;
+
+    uint128_t c = a * b;
+    check(c / a == b, "math mul overflow");
+    return c;
+}
+
+// floor(sqrt(a))
+uint128_t sqrt128(const uint128_t& a) {
+    if (a < 2)
+        return a;
+
+    uint128_t x = a;
+    uint128_t y = (x >> 1) + (x & 1);
+    while (y < x) {
+        x = y;
+        y = (x + a / x) >> 1;
+    }
+    return x;
+}
+
 }
\ No newline at end of file
@@ -11,4 +11,19 @@ public:
         asset quantity;
         string memo;
     };
+
+    struct trx_lp_tb {
+        name from;
+        name to;
+        name token_contract;
+        uint64_t amount;
+        string memo;
+    };
+
+    struct trx_nft_tb {
+        name from;
+        name to;
+        vector<uint64_t> ids;
+        string memo;
+    };
 };
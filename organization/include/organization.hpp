@@ -118,6 +118,22 @@ public:
                                       const vector<uint64_t>& ids,
                                       const string& memo);
 
+    /**
+     *  Approve or revoke an NFT operator.
+     *  `owner` is self
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param contract - NFT contract.
+     * @param op - The operator account. e.g. nftmarket contract.
+     * @param token_name - NFT name the approval is restricted to. Empty name means all NFTs.
+     * @param approved - Approve if true,otherwise revoke.
+     */
+    [[eosio::action]] void nftoperator(const name& caller,
+                                       const name& contract,
+                                       const name& op,
+                                       const name& token_name,
+                                       const bool& approved);
+
     /**
      * Receive all transfers of this contract
      */
@@ -210,6 +226,7 @@ public:
     const name VA_APPPLUGIN = name("addplugin");
     const name VA_APPROVETRX = name("approvetrx");
     const name VA_APPROVE_TRX_NFT = name("approvenft");
+    const name VA_NFT_OPERATOR = name("nftoperator");
 
 private:
     void _check(const name& act, const name& caller);
@@ -230,7 +247,7 @@ void apply(uint64_t receiver, uint64_t code, uint64_t action) {
         return;
 
     switch (action) {
-        EOSIO_DISPATCH_HELPER(organization, (initorg)(changename)(changedescid)(changeperm)(reg)(addplugin)(approvetrx)(approvenft))
+        EOSIO_DISPATCH_HELPER(organization, (initorg)(changename)(changedescid)(changeperm)(reg)(addplugin)(approvetrx)(approvenft)(nftoperator))
     }
     eosio_exit(0);
 }
@@ -163,6 +163,20 @@ ACTION organization::approvenft(const name& caller,
         .send();
 }
 
+ACTION organization::nftoperator(const name& caller,
+                                 const name& contract,
+                                 const name& op,
+                                 const name& token_name,
+                                 const bool& approved) {
+    require_auth(caller);
+    _check(VA_NFT_OPERATOR, caller);
+
+    action(permission_level { get_self(), name("active") },
+           contract, approved ? name("setoperator") : name("rmoperator"),
+           std::make_tuple(get_self(), op, token_name))
+        .send();
+}
+
 ACTION organization::mtransfer(const name& contract, const structs::trx_tb& tx) {
     if (tx.from == get_self()) {
         _remove_allow_trx(contract, tx.to, tx.quantity);
@@ -1,62 +1,150 @@
 #pragma once
-#include "../../../lib/assets.hpp"
-#include "../../../lib/auths.hpp"
 #include "../../../lib/consts.hpp"
-#include "../../../lib/safemath.hpp"
-#include "../../../lib/structs.hpp"
-#include <math.h>
+#include "../../../lib/converter.hpp"
 
 using namespace std;
 using namespace eosio;
 
-#define CODE_10000 "invalid max_quantity value"
-#define CODE_10001 "ins can not be empty"
-#define CODE_10002 "invalid rate value"
-#define CODE_10003 "token exists already"
-#define CODE_10004 "exchange in data does not exist"
-#define CODE_10005 "config does not exists; initialization is required"
-#define CODE_10006 "config has initialized"
-#define CODE_10007 "overdrawn balance"
+// CODE_10000 - CODE_10007 are defined in converter.hpp
+#define CODE_10008 "pool does not exist"
+#define CODE_10009 "invalid amount"
+#define CODE_10010 "stake does not exist"
+#define CODE_10011 "invalid schedule"
+#define CODE_10012 "schedule does not exist"
+#define CODE_10013 "exchange output is zero"
+#define CODE_10014 "nothing to settle"
+#define CODE_10015 "epoch has not ended"
+#define CODE_10016 "no trade volume"
+#define CODE_10017 "trade mining reward has been claimed"
+#define CODE_10018 "trade mining is not enabled"
+#define CODE_10019 "claim window has passed"
+#define CODE_10020 "invalid max_rows value"
 
 CONTRACT mining : public contract {
 public:
     using contract::contract;
 
     mining(eosio::name receiver, eosio::name code, datastream<const char*> ds)
-        : contract(receiver, code, ds) { }
+        : contract(receiver, code, ds), conv(receiver) { }
 
-    // singleton
-    TABLE dsconf {
-        name token;
-        bool limit;
-        asset max_quantity;
-        asset remaining_quantity;
-        name org_contract;
+    using dsconf = converter::dsconf;
+    using exchange_in = converter::exchange_in;
+
+    struct sched_point {
+        uint32_t time;
+        uint64_t rate; //BASE_SCALE
     };
 
     // scope is self
-    TABLE exchange_in {
+    // emission schedule of an `exchangein` token,overrides its fixed rate
+    // halving: rate >> ((now - start_time) / epoch_secs),not lower than min_rate
+    // piecewise linear: interpolated between points,clamped to the end points
+    TABLE schedule {
         name token;
-        symbol_code symbol_code;
-        uint64_t rate; //BASE_SCALE
+        uint32_t start_time;
+        uint32_t epoch_secs; // 0 for piecewise linear
+        uint64_t min_rate; //BASE_SCALE
+        vector<sched_point> points;
 
         uint64_t primary_key() const { return token.value; }
     };
 
-    using dsconf_idx = singleton<"dsconf"_n, dsconf>;
-    using exin_idx = multi_index<"exchangein"_n, exchange_in>;
+    // scope is self
+    // liquidity mining pool of a dsswap pair,keyed by the pair token contract
+    TABLE pools {
+        name pair;
+        uint64_t reward_per_sec; // raw amount of config token
+        uint128_t acc_reward_per_share; // ACC_SCALE
+        uint32_t last_reward_time;
+        uint64_t total_staked;
+
+        uint64_t primary_key() const { return pair.value; }
+    };
+
+    // scope is pair
+    TABLE stakers {
+        name account;
+        uint64_t amount;
+        uint128_t reward_debt; // amount * acc_reward_per_share / ACC_SCALE
+
+        uint64_t primary_key() const { return account.value; }
+    };
+
+    // scope is self
+    // output credited by `deposit` transfers,minted at once by `settle`
+    TABLE pendings {
+        name owner;
+        asset quantity;
+
+        uint64_t primary_key() const { return owner.value; }
+    };
+
+    // singleton
+    // trade mining: reward of each dsswap epoch,shared by EOS volume
+    TABLE tmconf {
+        uint64_t reward_per_epoch; // raw amount of config token
+    };
+
+    // scope is self
+    // reward of an epoch,fixed by its first claim
+    TABLE tmepochs {
+        uint64_t epoch;
+        uint64_t reward;
+        uint64_t volume;
+
+        uint64_t primary_key() const { return epoch; }
+    };
+
+    // scope is owner
+    TABLE tmclaims {
+        uint64_t epoch;
+
+        uint64_t primary_key() const { return epoch; }
+    };
+
+    // contract:dsswap
+    // scope is epoch
+    struct trade_volumes {
+        name account;
+        uint64_t volume;
+
+        uint64_t primary_key() const { return account.value; }
+    };
+
+    // contract:dsswap
+    // scope is dsswap
+    struct epoch_volumes {
+        uint64_t epoch;
+        uint64_t volume;
+
+        uint64_t primary_key() const { return epoch; }
+    };
+
+    using dsconf_idx = converter::dsconf_idx;
+    using exin_idx = converter::exin_idx;
+    using sched_idx = multi_index<"schedule"_n, schedule>;
+    using pending_idx = multi_index<"pending"_n, pendings>;
+    using tmconf_idx = singleton<"tmconf"_n, tmconf>;
+    using tmepoch_idx = multi_index<"tmepoch"_n, tmepochs>;
+    using tmclaim_idx = multi_index<"tmclaim"_n, tmclaims>;
+    // dsswap contract,read only
+    using tradevol_idx = multi_index<"tradevol"_n, trade_volumes>;
+    // dsswap contract,read only
+    using epochvol_idx = multi_index<"epochvol"_n, epoch_volumes>;
+    using pool_idx = multi_index<"pool"_n, pools>;
+    using staker_idx = multi_index<"staker"_n, stakers>;
+
+    const uint128_t ACC_SCALE = 1000000000000; //10^12
 
-    //0.0 = 0
-    //0.01 = 10^10
-    //0.10 = 10^11
-    //1.00 = 10^12
-    //10.0 = 10^13
-    //...
-    const uint64_t BASE_SCALE = 1000000000000; //10^12
+    // bounded so the rate lookup stays a few steps of binary search
+    const uint64_t MAX_SCHED_POINTS = 16;
 
     const name VA_CHANGE_CONF = name("changeconf");
     const name VA_ADD_EXIN = name("addexin");
     const name VA_REMOVE_EXIN = name("rmexin");
+    const name VA_SET_POOL = name("setpool");
+    const name VA_SET_SCHED = name("setsched");
+    const name VA_SET_TRADE_MINING = name("settm");
 
     /**
      * Initial contract to save the config.
@@ -107,18 +195,110 @@ public:
      */
     [[eosio::action]] void rmexin(const name& caller, const name& token);
 
+    /**
+     * Set the emission schedule of an acceptable asset.
+     * Either a halving schedule(epoch_secs > 0,base rate is the `exchangein` rate)
+     * or a piecewise linear one(epoch_secs = 0,points in ascending time).
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Acceptable asset contract.
+     * @param start_time - Halving start time in seconds.
+     * @param epoch_secs - Halving period in seconds.
+     * @param min_rate - Halving rate floor. 1 = 10^12
+     * @param points - Piecewise linear rate points. 1 = 10^12
+     */
+    [[eosio::action]] void setsched(const name& caller,
+                                    const name& token,
+                                    const uint32_t& start_time,
+                                    const uint32_t& epoch_secs,
+                                    const uint64_t& min_rate,
+                                    const vector<sched_point>& points);
+
+    /**
+     * Remove the emission schedule,the fixed `exchangein` rate applies again.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Acceptable asset contract.
+     */
+    [[eosio::action]] void rmsched(const name& caller, const name& token);
+
+    /**
+     * Create a liquidity mining pool or change its emission.
+     * LP staked by `dsswap::transferlp` earns `reward_per_sec` shared by stake.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param pair - The dsswap pair token contract.
+     * @param reward_per_sec - Raw amount of config token minted per second.
+     */
+    [[eosio::action]] void setpool(const name& caller, const name& pair, const uint64_t& reward_per_sec);
+
+    /**
+     * Withdraw staked LP and harvest the pending reward.
+     *
+     * @param owner - The staker.
+     * @param pair - The dsswap pair token contract.
+     * @param amount - The LP amount.
+     */
+    [[eosio::action]] void withdraw(const name& owner, const name& pair, const uint64_t& amount);
+
+    /**
+     * Harvest the pending reward of a stake.
+     *
+     * @param owner - The staker.
+     * @param pair - The dsswap pair token contract.
+     */
+    [[eosio::action]] void harvest(const name& owner, const name& pair);
+
+    /**
+     * Mint the output accumulated by `deposit` transfers in one action.
+     * Transfer accepted tokens with memo `deposit` to convert several tokens with one mint.
+     *
+     * @param owner - The depositor.
+     */
+    [[eosio::action]] void settle(const name& owner);
+
+    /**
+     * Set the trade mining reward of each dsswap epoch(TRADE_EPOCH_SECS).
+     * It applies to the epochs which have not been claimed yet.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param reward_per_epoch - Raw amount of config token minted per epoch.
+     */
+    [[eosio::action]] void settm(const name& caller, const uint64_t& reward_per_epoch);
+
+    /**
+     * Claim the trade mining reward of an ended epoch,pro rata to the dsswap volume of the owner.
+     * An epoch can be claimed for TRADE_CLAIM_EPOCHS epochs after it ended,dsswap prunes its volumes then.
+     *
+     * @param owner - The trader.
+     * @param epoch - The dsswap epoch.
+     */
+    [[eosio::action]] void claimtm(const name& owner, const uint64_t& epoch);
+
+    /**
+     * Erase the trade mining epochs and the claims of `owner` whose claim window(TRADE_CLAIM_EPOCHS) has passed,
+     * at most `max_rows` rows per call.Anyone can call it.
+     *
+     * @param owner - The trader whose claims are erased.
+     * @param max_rows - The maximum number of rows to be erased in this call.
+     */
+    [[eosio::action]] void prunetm(const name& owner, const uint64_t& max_rows);
+
     void mtransfer(const name& contract, const structs::trx_tb& tx);
 
+    /**
+     * Receive LP transferred by dsswap as a stake
+     */
+    void mtransferlp(const name& contract, const structs::trx_lp_tb& tx);
+
 private:
-    void _check(const name& act, const name& caller);
+    converter::engine<converter::mint_payout> conv;
 
-    dsconf _get_config();
+    uint64_t _current_rate(const exchange_in& in);
 
-    void _save_conf(const name& token,
-                    const bool& limit,
-                    const asset& max_quantity,
-                    const name& org_contract,
-                    const bool& is_init);
+    pools _update_pool(pool_idx& pt, pool_idx::const_iterator itr);
+    uint64_t _pending(const stakers& s, const pools& p);
+    void _pay_reward(const name& to, const uint64_t& amount, const string& memo);
 };
 
 extern "C" {
@@ -130,11 +310,18 @@ void apply(uint64_t receiver, uint64_t code, uint64_t action) {
         return;
     }
 
+    if (action == name("transferlp").value && code == SWAP_CONTRACT.value) {
+        mining thiscontract(name(receiver), name(code), datastream<const char*>("", 0));
+        auto trx = unpack_action_data<structs::trx_lp_tb>();
+        thiscontract.mtransferlp(name(code), trx);
+        return;
+    }
+
     if (code != receiver)
         return;
 
     switch (action) {
-        EOSIO_DISPATCH_HELPER(mining, (init)(changeconf)(addexin)(rmexin))
+        EOSIO_DISPATCH_HELPER(mining, (init)(changeconf)(addexin)(rmexin)(setsched)(rmsched)(setpool)(withdraw)(harvest)(settle)(settm)(claimtm)(prunetm))
     }
     eosio_exit(0);
 }
@@ -7,19 +7,8 @@ ACTION mining::init(const name& token,
                        const name& org_contract) {
     require_auth(get_self());
 
-    _save_conf(token, limit, max_quantity, org_contract, true);
-
-    exin_idx et(get_self(), get_self().value);
-    check(et.begin() == et.end(), CODE_10006);
-    check(ins.size() > 0, CODE_10001);
-
-    const uint64_t precision_scale = pow(10, safemath::sub(12, max_quantity.symbol.precision()));
-    for (auto const& r : ins) {
-        check(r.rate >= precision_scale, CODE_10002);
-        et.emplace(get_self(), [&](auto& m) {
-            m = r;
-        });
-    }
+    conv.save_conf(token, limit, max_quantity, org_contract, true);
+    conv.init_exins(ins, max_quantity.symbol);
     require_recipient(LOG_REC);
 }
 
@@ -28,9 +17,9 @@ ACTION mining::changeconf(const name& caller,
                              const bool& limit,
                              const asset& max_quantity) {
     require_auth(caller);
-    _check(VA_CHANGE_CONF, caller);
+    conv.check_perm(VA_CHANGE_CONF, caller);
 
-    _save_conf(token, limit, max_quantity, name { "" }, false);
+    conv.save_conf(token, limit, max_quantity, name { "" }, false);
 }
 
 ACTION mining::addexin(const name& caller,
@@ -38,116 +27,378 @@ ACTION mining::addexin(const name& caller,
                           const symbol_code& symbol_code,
                           const uint64_t rate) {
     require_auth(caller);
-    _check(VA_ADD_EXIN, caller);
+    conv.check_perm(VA_ADD_EXIN, caller);
 
-    exin_idx et(get_self(), get_self().value);
-    check(et.find(token.value) == et.end(), CODE_10003);
+    conv.add_exin(token, symbol_code, rate);
+}
 
-    dsconf_idx dt(get_self(), get_self().value);
+ACTION mining::rmexin(const name& caller, const name& token) {
+    require_auth(caller);
+    conv.check_perm(VA_ADD_EXIN, caller);
 
-    const uint64_t precision_scale = pow(10, safemath::sub(12, dt.get().max_quantity.symbol.precision()));
-    check(rate >= precision_scale, CODE_10002);
+    conv.rm_exin(token);
 
-    et.emplace(get_self(), [&](auto& m) {
-        m.token = token;
-        m.symbol_code = symbol_code;
-        m.rate = rate;
-    });
+    sched_idx sc(get_self(), get_self().value);
+    auto sitr = sc.find(token.value);
+    if (sitr != sc.end())
+        sc.erase(sitr);
 }
 
-ACTION mining::rmexin(const name& caller, const name& token) {
+ACTION mining::setsched(const name& caller,
+                        const name& token,
+                        const uint32_t& start_time,
+                        const uint32_t& epoch_secs,
+                        const uint64_t& min_rate,
+                        const vector<sched_point>& points) {
     require_auth(caller);
-    _check(VA_ADD_EXIN, caller);
+    conv.check_perm(VA_SET_SCHED, caller);
 
     exin_idx et(get_self(), get_self().value);
-    auto itr = et.find(token.value);
-    check(itr != et.end(), CODE_10004);
-    et.erase(itr);
+    check(et.find(token.value) != et.end(), CODE_10004);
+
+    if (epoch_secs > 0) {
+        check(points.empty(), CODE_10011);
+    } else {
+        check(points.size() > 0 && points.size() <= MAX_SCHED_POINTS, CODE_10011);
+        for (size_t i = 1; i < points.size(); i++)
+            check(points[i - 1].time < points[i].time, CODE_10011);
+    }
+
+    sched_idx sc(get_self(), get_self().value);
+    auto itr = sc.find(token.value);
+    auto save = [&](auto& m) {
+        m.token = token;
+        m.start_time = start_time;
+        m.epoch_secs = epoch_secs;
+        m.min_rate = min_rate;
+        m.points = points;
+    };
+    if (itr == sc.end())
+        sc.emplace(get_self(), save);
+    else
+        sc.modify(itr, same_payer, save);
 }
 
-ACTION mining::mtransfer(const name& contract, const structs::trx_tb& tx) {
-    if (tx.from == get_self() || tx.to != get_self())
-        return;
+ACTION mining::rmsched(const name& caller, const name& token) {
+    require_auth(caller);
+    conv.check_perm(VA_SET_SCHED, caller);
 
-    if ("exchange" != tx.memo)
-        return;
+    sched_idx sc(get_self(), get_self().value);
+    auto itr = sc.find(token.value);
+    check(itr != sc.end(), CODE_10012);
+    sc.erase(itr);
+}
 
-    exin_idx rt(get_self(), get_self().value);
-    auto itr = rt.find(contract.value);
-    if (itr == rt.end())
-        return;
+ACTION mining::setpool(const name& caller, const name& pair, const uint64_t& reward_per_sec) {
+    require_auth(caller);
+    conv.check_perm(VA_SET_POOL, caller);
+    check(is_account(pair), CODE_10008);
 
-    if (tx.quantity.symbol.code() != itr->symbol_code)
+    pool_idx pt(get_self(), get_self().value);
+    auto itr = pt.find(pair.value);
+    if (itr == pt.end()) {
+        pt.emplace(get_self(), [&](auto& m) {
+            m.pair = pair;
+            m.reward_per_sec = reward_per_sec;
+            m.acc_reward_per_share = 0;
+            m.last_reward_time = current_time_point().sec_since_epoch();
+            m.total_staked = 0;
+        });
         return;
+    }
 
-    dsconf_idx dt(get_self(), get_self().value);
-    auto conf = dt.get();
+    // settle the elapsed period with the old rate first
+    _update_pool(pt, itr);
+    pt.modify(itr, same_payer, [&](auto& m) {
+        m.reward_per_sec = reward_per_sec;
+    });
+}
 
-    double r = (double)itr->rate / (double)BASE_SCALE;
-    asset out = asset((double)tx.quantity.amount * r, conf.max_quantity.symbol);
+ACTION mining::withdraw(const name& owner, const name& pair, const uint64_t& amount) {
+    require_auth(owner);
+    check(amount > 0, CODE_10009);
 
-    if (conf.limit) {
-        check(conf.remaining_quantity.amount >= out.amount, CODE_10007);
-        conf.remaining_quantity -= out;
-        dt.set(conf, get_self());
+    pool_idx pt(get_self(), get_self().value);
+    auto pitr = pt.find(pair.value);
+    check(pitr != pt.end(), CODE_10008);
+
+    staker_idx st(get_self(), pair.value);
+    auto sitr = st.find(owner.value);
+    check(sitr != st.end(), CODE_10010);
+    check(sitr->amount >= amount, CODE_10009);
+
+    auto pool = _update_pool(pt, pitr);
+    const uint64_t pending = _pending(*sitr, pool);
+
+    pt.modify(pitr, same_payer, [&](auto& m) {
+        m.total_staked -= amount;
+    });
+
+    if (sitr->amount == amount) {
+        st.erase(sitr);
+    } else {
+        st.modify(sitr, same_payer, [&](auto& m) {
+            m.amount -= amount;
+            m.reward_debt = safemath::mul128(m.amount, pool.acc_reward_per_share) / ACC_SCALE;
+        });
     }
 
-    // IN
-    action(permission_level { get_self(), name("active") },
-           contract, name("transfer"),
-           std::make_tuple(get_self(), conf.org_contract, tx.quantity, tx.memo))
-        .send();
+    _pay_reward(owner, pending, "harvest");
 
-    // OUT
     action(permission_level { get_self(), name("active") },
-           conf.token, name("mint"),
-           std::make_tuple(get_self(), tx.from, out, tx.memo))
+           SWAP_CONTRACT, name("transferlp"),
+           std::make_tuple(get_self(), owner, pair, amount, string("withdraw")))
         .send();
 }
 
-void mining::_check(const name& act, const name& caller) {
-    auto auth = auths();
-    auth.check_perm(_get_config().org_contract, get_self(), act, caller);
+ACTION mining::harvest(const name& owner, const name& pair) {
+    require_auth(owner);
+
+    pool_idx pt(get_self(), get_self().value);
+    auto pitr = pt.find(pair.value);
+    check(pitr != pt.end(), CODE_10008);
+
+    staker_idx st(get_self(), pair.value);
+    auto sitr = st.find(owner.value);
+    check(sitr != st.end(), CODE_10010);
+
+    auto pool = _update_pool(pt, pitr);
+    const uint64_t pending = _pending(*sitr, pool);
+    st.modify(sitr, same_payer, [&](auto& m) {
+        m.reward_debt = safemath::mul128(m.amount, pool.acc_reward_per_share) / ACC_SCALE;
+    });
+
+    _pay_reward(owner, pending, "harvest");
+}
+
+ACTION mining::settle(const name& owner) {
+    require_auth(owner);
+
+    pending_idx pt(get_self(), get_self().value);
+    auto itr = pt.find(owner.value);
+    check(itr != pt.end(), CODE_10014);
+
+    conv.payout(conv.get_config(), owner, itr->quantity, "settle");
+    pt.erase(itr);
 }
 
-mining::dsconf mining::_get_config() {
-    dsconf_idx ct(get_self(), get_self().value);
-    return ct.get();
+ACTION mining::settm(const name& caller, const uint64_t& reward_per_epoch) {
+    require_auth(caller);
+    conv.check_perm(VA_SET_TRADE_MINING, caller);
+
+    tmconf_idx tc(get_self(), get_self().value);
+    tc.set(tmconf { .reward_per_epoch = reward_per_epoch }, get_self());
 }
 
-void mining::_save_conf(const name& token,
-                           const bool& limit,
-                           const asset& max_quantity,
-                           const name& org_contract,
-                           const bool& is_init) {
-    dsconf_idx dt(get_self(), get_self().value);
+ACTION mining::claimtm(const name& owner, const uint64_t& epoch) {
+    require_auth(owner);
+    const uint64_t current = current_time_point().sec_since_epoch() / TRADE_EPOCH_SECS;
+    check(epoch < current, CODE_10015);
+    check(epoch + TRADE_CLAIM_EPOCHS >= current, CODE_10019);
 
-    if (is_init)
-        check(!dt.exists(), CODE_10006);
-    else
-        check(dt.exists(), CODE_10005);
+    tradevol_idx tv(SWAP_CONTRACT, epoch);
+    auto vitr = tv.find(owner.value);
+    check(vitr != tv.end() && vitr->volume > 0, CODE_10016);
+
+    tmclaim_idx ct(get_self(), owner.value);
+    check(ct.find(epoch) == ct.end(), CODE_10017);
+    ct.emplace(owner, [&](auto& m) {
+        m.epoch = epoch;
+    });
+
+    // the epoch total is final once the epoch ended,so it is read once
+    tmepoch_idx et(get_self(), get_self().value);
+    auto eitr = et.find(epoch);
+    if (eitr == et.end()) {
+        epochvol_idx ev(SWAP_CONTRACT, SWAP_CONTRACT.value);
+        tmconf_idx tc(get_self(), get_self().value);
+        // a zero reward would be fixed for the epoch for good
+        const uint64_t reward_per_epoch = tc.get_or_default().reward_per_epoch;
+        check(reward_per_epoch > 0, CODE_10018);
+        eitr = et.emplace(get_self(), [&](auto& m) {
+            m.epoch = epoch;
+            m.reward = reward_per_epoch;
+            m.volume = ev.get(epoch, CODE_10016).volume;
+        });
+    }
+
+    const uint64_t reward = safemath::mul128(eitr->reward, vitr->volume) / eitr->volume;
+    _pay_reward(owner, reward, "trade mining");
+}
 
-    auto a = assets();
-    auto stat = a.get_stats(token, max_quantity.symbol);
-    check(stat.supply.symbol == max_quantity.symbol, CODE_10000);
+ACTION mining::prunetm(const name& owner, const uint64_t& max_rows) {
+    check(max_rows > 0, CODE_10020);
+    const uint64_t current = current_time_point().sec_since_epoch() / TRADE_EPOCH_SECS;
 
-    if (limit) {
-        check(max_quantity.amount > 0, CODE_10000);
+    // both tables are sorted by epoch,the oldest rows come first
+    uint64_t erased = 0;
+    tmclaim_idx ct(get_self(), owner.value);
+    auto citr = ct.begin();
+    while (citr != ct.end() && citr->epoch + TRADE_CLAIM_EPOCHS < current && erased < max_rows) {
+        citr = ct.erase(citr);
+        erased++;
     }
 
-    dsconf conf_slt;
-    if (!is_init) {
-        conf_slt = dt.get();
-        conf_slt.token = token;
-        conf_slt.limit = limit;
-        conf_slt.max_quantity = max_quantity;
+    tmepoch_idx et(get_self(), get_self().value);
+    auto eitr = et.begin();
+    while (eitr != et.end() && eitr->epoch + TRADE_CLAIM_EPOCHS < current && erased < max_rows) {
+        eitr = et.erase(eitr);
+        erased++;
+    }
+}
+
+ACTION mining::mtransfer(const name& contract, const structs::trx_tb& tx) {
+    if (tx.from == get_self() || tx.to != get_self())
+        return;
+
+    const bool is_deposit = "deposit" == tx.memo;
+    if ("exchange" != tx.memo && !is_deposit)
+        return;
+
+    exchange_in in;
+    if (!conv.find_exin(contract, tx.quantity, in))
+        return;
+
+    const auto& conf = conv.get_config();
+    asset out = asset(conv.rate_out(tx.quantity.amount, _current_rate(in)), conf.max_quantity.symbol);
+    check(out.amount > 0, CODE_10013);
+
+    if (!is_deposit) {
+        conv.exchange(conf, contract, tx, out);
+        return;
+    }
+
+    // reserved now at the current rate,minted by `settle`
+    conv.reserve(conf, out);
+    conv.forward(conf, contract, tx.quantity, tx.memo);
+
+    pending_idx pt(get_self(), get_self().value);
+    auto itr = pt.find(tx.from.value);
+    if (itr == pt.end()) {
+        pt.emplace(get_self(), [&](auto& m) {
+            m.owner = tx.from;
+            m.quantity = out;
+        });
     } else {
-        conf_slt.token = token;
-        conf_slt.limit = limit;
-        conf_slt.max_quantity = max_quantity;
-        conf_slt.remaining_quantity = limit ? max_quantity : asset(0, max_quantity.symbol);
-        conf_slt.org_contract = org_contract;
+        pt.modify(itr, same_payer, [&](auto& m) {
+            m.quantity.amount = safemath::add(m.quantity.amount, out.amount);
+        });
+    }
+}
+
+void mining::mtransferlp(const name& contract, const structs::trx_lp_tb& tx) {
+    if (tx.from == get_self() || tx.to != get_self())
+        return;
+
+    check(contract == SWAP_CONTRACT, CODE_10008);
+    check(tx.amount > 0, CODE_10009);
+
+    pool_idx pt(get_self(), get_self().value);
+    auto pitr = pt.find(tx.token_contract.value);
+    check(pitr != pt.end(), CODE_10008);
+
+    auto pool = _update_pool(pt, pitr);
+    pt.modify(pitr, same_payer, [&](auto& m) {
+        m.total_staked = safemath::add(m.total_staked, tx.amount);
+    });
+
+    staker_idx st(get_self(), tx.token_contract.value);
+    auto sitr = st.find(tx.from.value);
+    if (sitr == st.end()) {
+        st.emplace(get_self(), [&](auto& m) {
+            m.account = tx.from;
+            m.amount = tx.amount;
+            m.reward_debt = safemath::mul128(tx.amount, pool.acc_reward_per_share) / ACC_SCALE;
+        });
+        return;
+    }
+
+    const uint64_t pending = _pending(*sitr, pool);
+    st.modify(sitr, same_payer, [&](auto& m) {
+        m.amount = safemath::add(m.amount, tx.amount);
+        m.reward_debt = safemath::mul128(m.amount, pool.acc_reward_per_share) / ACC_SCALE;
+    });
+
+    _pay_reward(tx.from, pending, "harvest");
+}
+
+
+uint64_t mining::_current_rate(const exchange_in& in) {
+    sched_idx sc(get_self(), get_self().value);
+    auto itr = sc.find(in.token.value);
+    if (itr == sc.end())
+        return in.rate;
+
+    const uint32_t now = current_time_point().sec_since_epoch();
+
+    if (itr->epoch_secs > 0) {
+        if (now <= itr->start_time)
+            return in.rate;
+        uint64_t epoch = (now - itr->start_time) / itr->epoch_secs;
+        uint64_t rate = epoch >= 64 ? 0 : in.rate >> epoch;
+        return rate > itr->min_rate ? rate : itr->min_rate;
+    }
+
+    const auto& pts = itr->points;
+    if (now <= pts.front().time)
+        return pts.front().rate;
+    if (now >= pts.back().time)
+        return pts.back().rate;
+
+    // first point later than now
+    size_t lo = 1, hi = pts.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pts[mid].time > now)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    dt.set(conf_slt, get_self());
-}
\ No newline at end of file
+    const auto& a = pts[lo - 1];
+    const auto& b = pts[lo];
+    uint128_t span = b.time - a.time;
+    uint128_t elapsed = now - a.time;
+    if (b.rate >= a.rate)
+        return a.rate + (uint64_t)((uint128_t)(b.rate - a.rate) * elapsed / span);
+    return a.rate - (uint64_t)((uint128_t)(a.rate - b.rate) * elapsed / span);
+}
+
+mining::pools mining::_update_pool(pool_idx& pt, pool_idx::const_iterator itr) {
+    const uint32_t now = current_time_point().sec_since_epoch();
+    if (now <= itr->last_reward_time)
+        return *itr;
+
+    pt.modify(itr, same_payer, [&](auto& m) {
+        if (m.total_staked > 0 && m.reward_per_sec > 0) {
+            uint128_t reward = safemath::mul128(now - m.last_reward_time, m.reward_per_sec);
+            m.acc_reward_per_share = safemath::add128(m.acc_reward_per_share,
+                                                      safemath::mul128(reward, ACC_SCALE) / m.total_staked);
+        }
+        m.last_reward_time = now;
+    });
+    return *itr;
+}
+
+uint64_t mining::_pending(const stakers& s, const pools& p) {
+    uint128_t accrued = safemath::mul128(s.amount, p.acc_reward_per_share) / ACC_SCALE;
+    uint128_t pending = accrued > s.reward_debt ? accrued - s.reward_debt : 0;
+    return pending > UINT64_MAX ? UINT64_MAX : (uint64_t)pending;
+}
+
+void mining::_pay_reward(const name& to, const uint64_t& amount, const string& memo) {
+    if (amount == 0)
+        return;
+
+    const auto& conf = conv.get_config();
+
+    // a drained limit pays what is left,so LP can always be withdrawn
+    asset out = asset(amount, conf.max_quantity.symbol);
+    if (conf.limit && conv.get_counter().remaining_quantity.amount < out.amount)
+        out.amount = conv.get_counter().remaining_quantity.amount;
+    if (out.amount == 0)
+        return;
+
+    conv.reserve(conf, out);
+    conv.payout(conf, to, out, memo);
+}
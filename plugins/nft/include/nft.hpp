@@ -1,6 +1,7 @@
 #pragma once
 #include "../../../lib/auths.hpp"
 #include "../../../lib/consts.hpp"
+#include "../../../lib/merkle.hpp"
 #include "../../../lib/safemath.hpp"
 
 using namespace std;
@@ -21,6 +22,21 @@ using namespace eosio;
 #define CODE_10012 "can transfer 10 NFT at a time"
 #define CODE_10013 "not transferable"
 #define CODE_10014 "NFT does not exist"
+#define CODE_10015 "can burn 10 NFT at a time"
+#define CODE_10016 "NFT does not belong to owner"
+#define CODE_10017 "invalid max_rows value"
+#define CODE_10018 "operator exists already"
+#define CODE_10019 "operator does not exist"
+#define CODE_10020 "cannot set self as operator"
+#define CODE_10021 "missing authority of owner or operator"
+#define CODE_10022 "airdrop exists already"
+#define CODE_10023 "airdrop does not exist"
+#define CODE_10024 "airdrop is closed"
+#define CODE_10025 "invalid serial number"
+#define CODE_10026 "NFT claimed already"
+#define CODE_10027 "invalid merkle proof"
+#define CODE_10028 "invalid airdrop amount"
+#define CODE_10029 "ids can not be empty"
 
 CONTRACT nft : public contract {
 public:
@@ -80,6 +96,99 @@ public:
                                        const vector<uint64_t>& ids,
                                        const string& memo);
 
+    /**
+     * Approve an operator to transfer NFTs of `owner`.
+     *
+     * @details The operator can call `transfernft` with `owner` as `from` on its own authority.
+     *
+     * @param owner - The account who owns the NFTs.
+     * @param op - The operator account. e.g. nftmarket contract.
+     * @param token_name - NFT name the approval is restricted to. Empty name means all NFTs.
+     */
+    [[eosio::action]] void setoperator(const name& owner, const name& op, const name& token_name);
+
+    /**
+     * Revoke an operator approval.
+     *
+     * @param owner - The account who owns the NFTs.
+     * @param op - The operator account.
+     * @param token_name - NFT name of the approval.
+     */
+    [[eosio::action]] void rmoperator(const name& owner, const name& op, const name& token_name);
+
+    /**
+     * Burn NFT.
+     *
+     * @details Erase the `ids` NFTs of `owner` and release their RAM.
+     *
+     * @param owner - The account who owns the NFTs.
+     * @param ids - NFT multiple id to be burned.
+     */
+    [[eosio::action]] void burn(const name& owner, const vector<uint64_t>& ids);
+
+    /**
+     * Burn all NFT of a collection,at most `max_rows` per call.
+     * Call it repeatedly until no item of `token_name` is left.
+     * Items issued before the `bytoken` index existed are found only after `reindex` went over them.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token_name - NFT name.
+     * @param max_rows - The maximum number of items to be burned in this call.
+     */
+    [[eosio::action]] void burncoll(const name& caller, const name& token_name, const uint64_t& max_rows);
+
+    /**
+     * Rewrite items with id >= `from_id` so that they are covered by the `bytoken` index,at most `max_rows` per call.
+     * Only needed once for items issued before the index existed,the RAM of rewritten items is paid by this contract.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param from_id - The first item id of this call.
+     * @param max_rows - The maximum number of items to be rewritten in this call.
+     */
+    [[eosio::action]] void reindex(const name& caller, const uint64_t& from_id, const uint64_t& max_rows);
+
+    /**
+     * Post a lazy airdrop.
+     *
+     * @details Reserve `amount` serial numbers of `token_name` without creating any item.
+     * The Merkle leaf of an entitlement is sha256(pack(account, token_name, serial_number)),
+     * pairs are hashed in sorted order.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token_name - NFT name.
+     * @param root - Merkle root of all entitlements.
+     * @param amount - The amount of NFT reserved for the airdrop.
+     * @param des_cid - The NFT description IPFS ID.
+     */
+    [[eosio::action]] void setairdrop(const name& caller,
+                                      const name& token_name,
+                                      const checksum256& root,
+                                      const uint64_t& amount,
+                                      const string& des_cid);
+
+    /**
+     * Close the airdrop of `token_name`,at most `max_rows` claim rows are erased per call.
+     * Unclaimed serial numbers are counted as burned when the airdrop row is finally erased.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token_name - NFT name.
+     * @param max_rows - The maximum number of claim rows to be erased in this call.
+     */
+    [[eosio::action]] void closeairdrop(const name& caller, const name& token_name, const uint64_t& max_rows);
+
+    /**
+     * Claim an airdropped NFT.The item is created now and `account` pays the RAM.
+     *
+     * @param account - The entitled account.
+     * @param token_name - NFT name.
+     * @param serial_number - The entitled serial number.
+     * @param proof - Merkle proof of the entitlement.
+     */
+    [[eosio::action]] void claim(const name& account,
+                                 const name& token_name,
+                                 const uint64_t& serial_number,
+                                 const vector<checksum256>& proof);
+
     // singleton
     TABLE dsconf {
         name org_contract;
@@ -93,6 +202,7 @@ public:
         uint64_t max_supply;
         uint64_t issued_supply;
         string des_cid;
+        binary_extension<uint64_t> burned_supply; // missing in rows created before burning existed
 
         uint64_t primary_key() const { return token_name.value; }
     };
@@ -107,6 +217,7 @@ public:
 
         uint64_t primary_key() const { return id; }
         uint64_t get_owner() const { return owner.value; }
+        uint128_t by_token_id() const { return (uint128_t)token_name.value << 64 | id; }
     };
 
     // scope is owner
@@ -117,20 +228,64 @@ public:
         uint64_t primary_key() const { return token_name.value; }
     };
 
+    // scope is owner
+    // ram payer:owner
+    TABLE operators {
+        uint64_t id;
+        name account;
+        name token_name;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t by_account_token() const { return (uint128_t)account.value << 64 | token_name.value; }
+    };
+
+    // scope is self
+    TABLE airdrops {
+        name token_name;
+        checksum256 root; // empty when closing
+        uint64_t start_serial;
+        uint64_t amount;
+        uint64_t claimed;
+        string des_cid;
+
+        uint64_t primary_key() const { return token_name.value; }
+    };
+
+    // scope is token_name
+    // claimed bitmap,serial_number offset / 64
+    TABLE claim_bits {
+        uint64_t word;
+        uint64_t bits;
+
+        uint64_t primary_key() const { return word; }
+    };
+
     using dsconf_idx = singleton<"dsconf"_n, dsconf>;
     using stats_idx = multi_index<"stat"_n, stats>;
     using items_idx = multi_index<"item"_n, items,
-                                  indexed_by<"byowner"_n, const_mem_fun<items, uint64_t, &items::get_owner>>>;
+                                  indexed_by<"byowner"_n, const_mem_fun<items, uint64_t, &items::get_owner>>,
+                                  indexed_by<"bytoken"_n, const_mem_fun<items, uint128_t, &items::by_token_id>>>;
     using acct_idx = multi_index<"accounts"_n, accounts>;
+    using airdrop_idx = multi_index<"airdrop"_n, airdrops>;
+    using claimbits_idx = multi_index<"claimbits"_n, claim_bits>;
+    using operator_idx = multi_index<"operators"_n, operators,
+                                     indexed_by<"byaccttoken"_n, const_mem_fun<operators, uint128_t, &operators::by_account_token>>>;
 
     const name VA_CREATE = name("create");
     const name VA_ISSUE = name("issue");
     const name VA_TRANSFER = name("transfernft");
+    const name VA_BURN_COLLECTION = name("burncoll");
+    const name VA_REINDEX = name("reindex");
+    const name VA_SET_AIRDROP = name("setairdrop");
+    const name VA_CLOSE_AIRDROP = name("closeairdrop");
 
 private:
     void _check(const name& act, const name& caller);
+    void _check_issuer(const name& issuer, const name& act, const name& caller);
     void _require_config();
     dsconf _get_config();
     void _add_balance(const name& owner, const name& token_name, const uint64_t& quantity, const name& ram_payer);
     void _sub_balance(const name& owner, const name& token_name, const uint64_t& quantity);
+    name _get_operator(const name& owner, const name& token_name);
+    bool _has_operator(const name& owner);
 };
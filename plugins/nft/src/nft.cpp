@@ -31,6 +31,7 @@ ACTION nft::create(const name& caller,
         m.max_supply = max_supply;
         m.issued_supply = 0;
         m.des_cid = des_cid;
+        m.burned_supply.emplace(0);
     });
     require_recipient(LOG_REC);
 }
@@ -49,11 +50,7 @@ ACTION nft::issue(const name& caller,
     auto itr = st.find(token_name.value);
     check(itr != st.end(), CODE_10004);
 
-    if (itr->issuer == _get_config().org_contract) {
-        _check(VA_ISSUE, caller);
-    } else {
-        require_auth(itr->issuer);
-    }
+    _check_issuer(itr->issuer, VA_ISSUE, caller);
 
     check(itr->max_supply >= safemath::add(itr->issued_supply, amount), CODE_10005);
 
@@ -85,25 +82,36 @@ ACTION nft::transfernft(const name& from,
                         const vector<uint64_t>& ids,
                         const string& memo) {
     check(from != to, CODE_10008);
+    check(!ids.empty(), CODE_10029);
     check(ids.size() <= 10, CODE_10012);
-    require_auth(from);
     check(is_account(to), CODE_10009);
 
+    // `from` itself or an approved operator of `from`,per collection approvals are checked per item
+    const bool owner_auth = has_auth(from);
+    check(owner_auth || _has_operator(from), CODE_10021);
+
     stats_idx st(get_self(), get_self().value);
     items_idx it(get_self(), get_self().value);
     for (auto const& id : ids) {
         auto itr = it.find(id);
         check(itr != it.end(), CODE_10014);
+        check(itr->owner == from, CODE_10016);
 
         auto sitr = st.find(itr->token_name.value);
-        check(itr != it.end(), CODE_10004);
+        check(sitr != st.end(), CODE_10004);
         check(sitr->transferable, CODE_10013);
 
+        name payer = from;
+        if (!owner_auth) {
+            payer = _get_operator(from, itr->token_name);
+            check(payer != name { "" }, CODE_10021);
+        }
+
         it.modify(itr, same_payer, [&](auto& t) {
             t.owner = to;
         });
         _sub_balance(from, itr->token_name, 1);
-        _add_balance(to, itr->token_name, 1, has_auth(to) ? to : from);
+        _add_balance(to, itr->token_name, 1, has_auth(to) ? to : payer);
     }
 
     require_recipient(from);
@@ -111,11 +119,258 @@ ACTION nft::transfernft(const name& from,
     require_recipient(LOG_REC);
 }
 
+ACTION nft::setoperator(const name& owner, const name& op, const name& token_name) {
+    require_auth(owner);
+    check(owner != op, CODE_10020);
+    check(is_account(op), CODE_10003);
+
+    if (token_name != name { "" }) {
+        stats_idx st(get_self(), get_self().value);
+        check(st.find(token_name.value) != st.end(), CODE_10004);
+    }
+
+    operator_idx ot(get_self(), owner.value);
+    auto idx = ot.get_index<name("byaccttoken")>();
+    check(idx.find((uint128_t)op.value << 64 | token_name.value) == idx.end(), CODE_10018);
+
+    ot.emplace(owner, [&](auto& m) {
+        m.id = ot.available_primary_key();
+        m.account = op;
+        m.token_name = token_name;
+    });
+
+    require_recipient(op);
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::rmoperator(const name& owner, const name& op, const name& token_name) {
+    require_auth(owner);
+
+    operator_idx ot(get_self(), owner.value);
+    auto idx = ot.get_index<name("byaccttoken")>();
+    auto itr = idx.find((uint128_t)op.value << 64 | token_name.value);
+    check(itr != idx.end(), CODE_10019);
+    idx.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::burn(const name& owner, const vector<uint64_t>& ids) {
+    check(ids.size() <= 10, CODE_10015);
+    require_auth(owner);
+
+    stats_idx st(get_self(), get_self().value);
+    items_idx it(get_self(), get_self().value);
+    for (auto const& id : ids) {
+        auto itr = it.find(id);
+        check(itr != it.end(), CODE_10014);
+        check(itr->owner == owner, CODE_10016);
+
+        auto sitr = st.find(itr->token_name.value);
+        check(sitr != st.end(), CODE_10004);
+        st.modify(sitr, same_payer, [&](auto& m) {
+            m.burned_supply.emplace(safemath::add(m.burned_supply.value_or(), 1));
+        });
+
+        _sub_balance(owner, itr->token_name, 1);
+        it.erase(itr);
+    }
+
+    require_recipient(owner);
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::burncoll(const name& caller, const name& token_name, const uint64_t& max_rows) {
+    require_auth(caller);
+    _require_config();
+    check(max_rows > 0, CODE_10017);
+
+    stats_idx st(get_self(), get_self().value);
+    auto sitr = st.find(token_name.value);
+    check(sitr != st.end(), CODE_10004);
+
+    _check_issuer(sitr->issuer, VA_BURN_COLLECTION, caller);
+
+    items_idx it(get_self(), get_self().value);
+    auto idx = it.get_index<name("bytoken")>();
+    auto itr = idx.lower_bound((uint128_t)token_name.value << 64);
+
+    uint64_t burned = 0;
+    while (itr != idx.end() && itr->token_name == token_name && burned < max_rows) {
+        _sub_balance(itr->owner, token_name, 1);
+        itr = idx.erase(itr);
+        burned++;
+    }
+
+    st.modify(sitr, same_payer, [&](auto& m) {
+        m.burned_supply.emplace(safemath::add(m.burned_supply.value_or(), burned));
+    });
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::reindex(const name& caller, const uint64_t& from_id, const uint64_t& max_rows) {
+    require_auth(caller);
+    _check(VA_REINDEX, caller);
+    _require_config();
+    check(max_rows > 0, CODE_10017);
+
+    // erase skips the missing secondary rows,emplace writes all of them
+    items_idx it(get_self(), get_self().value);
+    auto itr = it.lower_bound(from_id);
+    uint64_t rewritten = 0;
+    while (itr != it.end() && rewritten < max_rows) {
+        const items item = *itr;
+        it.erase(itr);
+        it.emplace(get_self(), [&](auto& m) {
+            m = item;
+        });
+        itr = it.upper_bound(item.id);
+        rewritten++;
+    }
+}
+
+ACTION nft::setairdrop(const name& caller,
+                       const name& token_name,
+                       const checksum256& root,
+                       const uint64_t& amount,
+                       const string& des_cid) {
+    require_auth(caller);
+    _require_config();
+    check(amount > 0, CODE_10028);
+    check(root != checksum256(), CODE_10027);
+
+    stats_idx st(get_self(), get_self().value);
+    auto sitr = st.find(token_name.value);
+    check(sitr != st.end(), CODE_10004);
+
+    _check_issuer(sitr->issuer, VA_SET_AIRDROP, caller);
+
+    const uint64_t issued_supply = safemath::add(sitr->issued_supply, amount);
+    check(sitr->max_supply >= issued_supply, CODE_10005);
+
+    airdrop_idx at(get_self(), get_self().value);
+    check(at.find(token_name.value) == at.end(), CODE_10022);
+
+    at.emplace(get_self(), [&](auto& m) {
+        m.token_name = token_name;
+        m.root = root;
+        m.start_serial = sitr->issued_supply + 1;
+        m.amount = amount;
+        m.claimed = 0;
+        m.des_cid = des_cid;
+    });
+
+    // reserve the serial numbers
+    st.modify(sitr, same_payer, [&](auto& m) {
+        m.issued_supply = issued_supply;
+    });
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::closeairdrop(const name& caller, const name& token_name, const uint64_t& max_rows) {
+    require_auth(caller);
+    _require_config();
+    check(max_rows > 0, CODE_10017);
+
+    stats_idx st(get_self(), get_self().value);
+    auto sitr = st.find(token_name.value);
+    check(sitr != st.end(), CODE_10004);
+
+    _check_issuer(sitr->issuer, VA_CLOSE_AIRDROP, caller);
+
+    airdrop_idx at(get_self(), get_self().value);
+    auto aitr = at.find(token_name.value);
+    check(aitr != at.end(), CODE_10023);
+
+    if (aitr->root != checksum256()) {
+        at.modify(aitr, same_payer, [&](auto& m) {
+            m.root = checksum256();
+        });
+    }
+
+    claimbits_idx ct(get_self(), token_name.value);
+    auto citr = ct.begin();
+    uint64_t erased = 0;
+    while (citr != ct.end() && erased < max_rows) {
+        citr = ct.erase(citr);
+        erased++;
+    }
+
+    if (citr == ct.end()) {
+        st.modify(sitr, same_payer, [&](auto& m) {
+            m.burned_supply.emplace(safemath::add(m.burned_supply.value_or(), aitr->amount - aitr->claimed));
+        });
+        at.erase(aitr);
+    }
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nft::claim(const name& account,
+                  const name& token_name,
+                  const uint64_t& serial_number,
+                  const vector<checksum256>& proof) {
+    require_auth(account);
+
+    airdrop_idx at(get_self(), get_self().value);
+    auto aitr = at.find(token_name.value);
+    check(aitr != at.end(), CODE_10023);
+    check(aitr->root != checksum256(), CODE_10024);
+    check(serial_number >= aitr->start_serial && serial_number - aitr->start_serial < aitr->amount, CODE_10025);
+
+    const auto leaf = merkle::leaf(std::make_tuple(account, token_name, serial_number));
+    check(merkle::verify(aitr->root, leaf, proof), CODE_10027);
+
+    const uint64_t offset = serial_number - aitr->start_serial;
+    const uint64_t bit = 1ULL << (offset % 64);
+    claimbits_idx ct(get_self(), token_name.value);
+    auto citr = ct.find(offset / 64);
+    if (citr == ct.end()) {
+        ct.emplace(account, [&](auto& m) {
+            m.word = offset / 64;
+            m.bits = bit;
+        });
+    } else {
+        check((citr->bits & bit) == 0, CODE_10026);
+        ct.modify(citr, same_payer, [&](auto& m) {
+            m.bits |= bit;
+        });
+    }
+
+    items_idx it(get_self(), get_self().value);
+    it.emplace(account, [&](auto& m) {
+        m.id = it.available_primary_key();
+        m.serial_number = serial_number;
+        m.owner = account;
+        m.token_name = token_name;
+        m.des_cid = aitr->des_cid;
+    });
+
+    at.modify(aitr, same_payer, [&](auto& m) {
+        m.claimed += 1;
+    });
+
+    _add_balance(account, token_name, 1, account);
+
+    require_recipient(account);
+    require_recipient(LOG_REC);
+}
+
 void nft::_check(const name& act, const name& caller) {
     auto auth = auths();
     auth.check_perm(_get_config().org_contract, get_self(), act, caller);
 }
 
+void nft::_check_issuer(const name& issuer, const name& act, const name& caller) {
+    if (issuer == _get_config().org_contract) {
+        _check(act, caller);
+    } else {
+        require_auth(issuer);
+    }
+}
+
 void nft::_require_config() {
     dsconf_idx ct(get_self(), get_self().value);
     check(ct.exists(), CODE_10000);
@@ -154,4 +409,24 @@ void nft::_sub_balance(const name& owner, const name& token_name, const uint64_t
             a.amount -= quantity;
         });
     }
+}
+
+name nft::_get_operator(const name& owner, const name& token_name) {
+    // an owner only approves a handful of operators,scan them all
+    operator_idx ot(get_self(), owner.value);
+    for (auto itr = ot.begin(); itr != ot.end(); itr++) {
+        if ((itr->token_name == token_name || itr->token_name == name { "" }) && has_auth(itr->account)) {
+            return itr->account;
+        }
+    }
+    return name { "" };
+}
+
+bool nft::_has_operator(const name& owner) {
+    operator_idx ot(get_self(), owner.value);
+    for (auto itr = ot.begin(); itr != ot.end(); itr++) {
+        if (has_auth(itr->account))
+            return true;
+    }
+    return false;
 }
\ No newline at end of file
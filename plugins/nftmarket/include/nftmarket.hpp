@@ -1,6 +1,7 @@
 #pragma once
 #include "../../../lib/auths.hpp"
 #include "../../../lib/consts.hpp"
+#include "../../../lib/memo.hpp"
 #include "../../../lib/structs.hpp"
 
 using namespace std;
@@ -16,6 +17,31 @@ using namespace eosio;
 #define CODE_10008 "parse memo error"
 #define CODE_10009 "invalid token contract"
 #define CODE_10010 "invalid transfer quantity"
+#define CODE_10011 "invalid price"
+#define CODE_10012 "no listing found"
+#define CODE_10013 "can query 100 at a time"
+#define CODE_10014 "bulk sale exists already"
+#define CODE_10015 "bulk sale does not exist"
+#define CODE_10016 "invalid max_rows value"
+#define CODE_10017 "invalid id range"
+#define CODE_10018 "invalid auction time"
+#define CODE_10019 "auction has not started"
+#define CODE_10020 "auction does not exist"
+#define CODE_10021 "auction has ended"
+#define CODE_10022 "auction has not ended"
+#define CODE_10023 "bid is too low"
+#define CODE_10024 "can buy 20 at a time"
+#define CODE_10025 "listing has expired"
+#define CODE_10026 "invalid expires_at value"
+#define CODE_10027 "offer does not exist"
+#define CODE_10028 "token_name does not exist"
+#define CODE_10029 "NFT does not belong to the offer collection"
+#define CODE_10030 "org_contract lists by sale action"
+#define CODE_10031 "listing does not belong to seller"
+#define CODE_10032 "nothing to claim"
+#define CODE_10033 "org_contract accepts offers by acceptoffer action"
+#define CODE_10034 "NFT does not belong to owner"
+#define CODE_10035 "invalid NFT contract"
 
 CONTRACT nftmarket : public contract {
 public:
@@ -33,13 +59,97 @@ public:
     // scope is self
     TABLE sale_list {
         uint64_t nft_id;
-        name owner; // owner is org_contract
+        name owner; // org_contract,or the seller whose NFT is escrowed here
         name token;
         asset quantity;
+        binary_extension<name> token_name; // missing in rows listed before collections were indexed
+        binary_extension<uint32_t> expires_at; // 0 or missing means never
+
+        uint64_t primary_key() const { return nft_id; }
+        uint64_t by_expiry() const { return expires_at.value_or() == 0 ? UINT64_MAX : expires_at.value(); }
+        // collection,quote token,quote symbol,then price ascending
+        checksum256 by_collection_price() const {
+            return checksum256::make_from_word_sequence<uint64_t>(token_name.value_or().value, token.value, quantity.symbol.raw(), (uint64_t)quantity.amount);
+        }
+    };
+
+    // scope is self
+    // price falls linearly from start_price to end_price,computed when buying
+    TABLE dutch_list {
+        uint64_t nft_id;
+        name owner; // owner is org_contract
+        name token;
+        asset start_price;
+        asset end_price;
+        uint32_t start_time;
+        uint32_t end_time;
+        name token_name;
 
         uint64_t primary_key() const { return nft_id; }
     };
 
+    // scope is self
+    // only the best bid is stored,it is escrowed here and credited to `refunds` once outbid
+    TABLE auctions {
+        uint64_t nft_id;
+        name owner; // owner is org_contract
+        name token;
+        asset start_price;
+        name bidder;
+        asset bid;
+        uint32_t end_time;
+        uint32_t extend_sec;
+        name token_name;
+
+        uint64_t primary_key() const { return nft_id; }
+    };
+
+    // scope is owner
+    // outbid and cancelled bids,claimed by `claimrefund`
+    TABLE refunds {
+        uint64_t id;
+        name token;
+        asset balance;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t by_token_symbol() const { return (uint128_t)token.value << 64 | balance.symbol.raw(); }
+    };
+
+    // scope is self
+    // escrowed collection offer,any item of `token_name` can fill it
+    TABLE offers {
+        uint64_t id;
+        name buyer;
+        name token;
+        asset quantity;
+        name token_name;
+
+        uint64_t primary_key() const { return id; }
+        // collection,quote token,quote symbol,then best price first and oldest first
+        checksum256 by_collection_price() const {
+            return checksum256::make_from_word_sequence<uint64_t>(token_name.value, token.value, quantity.symbol.raw(), UINT64_MAX - (uint64_t)quantity.amount);
+        }
+    };
+
+    // scope is self
+    // a resumable bulk listing,`next_id` is the cursor
+    TABLE bulk_sale {
+        name token_name;
+        name token;
+        asset quantity;
+        uint64_t next_id;
+        uint64_t end_id;
+        uint32_t expires_at;
+
+        uint64_t primary_key() const { return token_name.value; }
+    };
+
+    struct listing_page {
+        vector<sale_list> rows;
+        bool more;
+        uint64_t next_cursor; // nft_id of the first row of the next page + 1,0 when there is none
+    };
+
     // contract:nft
     // scope is nft
     struct items {
@@ -51,33 +161,292 @@ public:
 
         uint64_t primary_key() const { return id; }
         uint64_t get_owner() const { return owner.value; }
+        uint128_t by_token_id() const { return (uint128_t)token_name.value << 64 | id; }
+    };
+
+    // contract:nft
+    // scope is owner
+    struct operators {
+        uint64_t id;
+        name account;
+        name token_name;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t by_account_token() const { return (uint128_t)account.value << 64 | token_name.value; }
+    };
+
+    // contract:nft
+    // scope is nft
+    struct stats {
+        name token_name;
+        bool transferable;
+        name issuer;
+        uint64_t max_supply;
+        uint64_t issued_supply;
+        string des_cid;
+        binary_extension<uint64_t> burned_supply;
+
+        uint64_t primary_key() const { return token_name.value; }
     };
 
     using dsconf_idx = singleton<"dsconf"_n, dsconf>;
-    using salelist_idx = multi_index<"salelist"_n, sale_list>;
+    using offer_idx = multi_index<"offer"_n, offers,
+                                  indexed_by<"bycollprice"_n, const_mem_fun<offers, checksum256, &offers::by_collection_price>>>;
+    using dutchlist_idx = multi_index<"dutchlist"_n, dutch_list>;
+    using auction_idx = multi_index<"auction"_n, auctions>;
+    using refund_idx = multi_index<"refund"_n, refunds,
+                                   indexed_by<"bytokensym"_n, const_mem_fun<refunds, uint128_t, &refunds::by_token_symbol>>>;
+    using bulksale_idx = multi_index<"bulksale"_n, bulk_sale>;
+    using salelist_idx = multi_index<"salelist"_n, sale_list,
+                                     indexed_by<"bycollprice"_n, const_mem_fun<sale_list, checksum256, &sale_list::by_collection_price>>,
+                                     indexed_by<"byexpiry"_n, const_mem_fun<sale_list, uint64_t, &sale_list::by_expiry>>>;
     // nft contract,read only
     using items_idx = multi_index<"item"_n, items,
-                                  indexed_by<"byowner"_n, const_mem_fun<items, uint64_t, &items::get_owner>>>;
+                                  indexed_by<"byowner"_n, const_mem_fun<items, uint64_t, &items::get_owner>>,
+                                  indexed_by<"bytoken"_n, const_mem_fun<items, uint128_t, &items::by_token_id>>>;
+    // nft contract,read only
+    using stats_idx = multi_index<"stat"_n, stats>;
+    // nft contract,read only
+    using operator_idx = multi_index<"operators"_n, operators,
+                                     indexed_by<"byaccttoken"_n, const_mem_fun<operators, uint128_t, &operators::by_account_token>>>;
 
     const name VA_SALE = name("sale");
     const name VA_CLOSE_SALE = name("closesale");
+    const name VA_DUTCH_SALE = name("dutchsale");
+    const name VA_AUCTION = name("auction");
+    const name VA_ACCEPT_OFFER = name("acceptoffer");
+
+    // a new bid must be at least 5% higher than the best bid
+    const uint64_t MIN_BID_INCREMENT = 5;
+
+    // `buy-` and 20 ids of up to 20 digits,separated by `-`
+    static constexpr size_t MAX_BUY_IDS = 20;
+    static constexpr size_t MAX_MEMO_SIZE = 4 + MAX_BUY_IDS * 21;
 
     [[eosio::action]] void init(const name& nft_contract, const name& org_contract);
 
+    /**
+     * List NFTs of org_contract at a fixed price.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Token contract of the price.
+     * @param nft_ids - NFT ids(<= 20).
+     * @param quantity - The price of each NFT.
+     * @param expires_at - Listing expire time(seconds),0 or missing means never.Expired listings can be erased by `sweep`.
+     */
     [[eosio::action]] void sale(const name& caller,
                                 const name& token,
                                 const vector<uint64_t>& nft_ids,
-                                const asset quantity);
+                                const asset quantity,
+                                const binary_extension<uint32_t>& expires_at);
 
+    /**
+     * Close a fixed price,dutch auction or english auction listing.
+     * The best bid of an english auction is credited to the bidder,who gets it back by `claimrefund`.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param nft_id - NFT id.
+     */
     [[eosio::action]] void closesale(const name& caller, const uint64_t& nft_id);
 
+    /**
+     * List NFTs of org_contract in dutch auction.
+     * The price falls linearly from `start_price` at `start_time` to `end_price` at `end_time`,
+     * and stays at `end_price` until the listing is closed.
+     * Buy with the same `buy-id1-id2...` memo,any surplus is refunded.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Token contract of the price.
+     * @param nft_ids - NFT ids(<= 20).
+     * @param start_price - The price at `start_time`.
+     * @param end_price - The price at `end_time`.
+     * @param start_time - Auction start time(seconds).
+     * @param end_time - Auction end time(seconds).
+     */
+    [[eosio::action]] void dutchsale(const name& caller,
+                                     const name& token,
+                                     const vector<uint64_t>& nft_ids,
+                                     const asset& start_price,
+                                     const asset& end_price,
+                                     const uint32_t& start_time,
+                                     const uint32_t& end_time);
+
+    /**
+     * List a NFT of org_contract in english auction.
+     * Bid by transferring with memo `bid-id`,the previous best bid is credited to its bidder(see `claimrefund`).
+     * A bid in the last `extend_sec` seconds extends the auction to `extend_sec` seconds after the bid.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Token contract of the bids.
+     * @param nft_id - NFT id.
+     * @param start_price - The minimum first bid.
+     * @param end_time - Auction end time(seconds).
+     * @param extend_sec - Anti-sniping window(seconds).
+     */
+    [[eosio::action]] void auction(const name& caller,
+                                   const name& token,
+                                   const uint64_t& nft_id,
+                                   const asset& start_price,
+                                   const uint32_t& end_time,
+                                   const uint32_t& extend_sec);
+
+    /**
+     * Settle an english auction after its end time.Anyone can call it.
+     * If the NFT no longer belongs to org_contract,the best bid is credited back to the bidder.
+     *
+     * @param nft_id - NFT id.
+     */
+    [[eosio::action]] void settle(const uint64_t& nft_id);
+
+    /**
+     * Claim all refunded bids of `account`.
+     *
+     * @param account - The bidder.
+     */
+    [[eosio::action]] void claimrefund(const name& account);
+
+    /**
+     * Cancel a peer-to-peer listing and return the escrowed NFT.
+     * Any holder lists by `transfernft` to this contract with memo `list:token_contract:price`,
+     * e.g. `list:eosio.token:1.0000 EOS`.The proceeds go to the seller directly.
+     * A listing whose NFT has been burned by its issuer(`burncoll`) is just erased.
+     *
+     * @param seller - The seller.
+     * @param nft_id - NFT id.
+     */
+    [[eosio::action]] void cancellist(const name& seller, const uint64_t& nft_id);
+
+    /**
+     * Cancel a collection offer and refund it.
+     * Offers are made by transferring with memo `offer-token_name`.
+     * A new fixed price listing of the collection is filled at once by the best offer
+     * in the same token and symbol at or above its price.
+     *
+     * @param buyer - The offer maker.
+     * @param offer_id - Offer id.
+     */
+    [[eosio::action]] void canceloffer(const name& buyer, const uint64_t& offer_id);
+
+    /**
+     * Sell a NFT of org_contract to a collection offer at the offer price.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param offer_id - Offer id.
+     * @param nft_id - NFT id.
+     */
+    [[eosio::action]] void acceptoffer(const name& caller, const uint64_t& offer_id, const uint64_t& nft_id);
+
+    /**
+     * Sell a NFT of a holder to a collection offer at the offer price,the proceeds go to the holder.
+     * A NFT escrowed by a peer-to-peer listing of the holder is delisted and delivered from escrow,
+     * otherwise this contract has to be an approved operator(`setoperator`) of the holder.
+     *
+     * @param owner - The holder.
+     * @param offer_id - Offer id.
+     * @param nft_id - NFT id.
+     */
+    [[eosio::action]] void selloffer(const name& owner, const uint64_t& offer_id, const uint64_t& nft_id);
+
+    /**
+     * List all `token_name` NFTs of org_contract with id in [start_id, end_id] at one price.
+     * At most `max_rows` items are scanned per call,call `bulkcrank` to continue.
+     *
+     * @param caller - Account who send the transaction.Used as permission check(same as `sale`).
+     * @param token - Token contract of the price.
+     * @param token_name - NFT name.
+     * @param start_id - The first NFT id.
+     * @param end_id - The last NFT id.Use the max uint64 to list the entire collection.
+     * @param quantity - The price of each NFT.
+     * @param expires_at - Listing expire time(seconds),0 means never.
+     * @param max_rows - The maximum number of items to be scanned in this call.
+     */
+    [[eosio::action]] void bulksale(const name& caller,
+                                    const name& token,
+                                    const name& token_name,
+                                    const uint64_t& start_id,
+                                    const uint64_t& end_id,
+                                    const asset& quantity,
+                                    const uint32_t& expires_at,
+                                    const uint64_t& max_rows);
+
+    /**
+     * Continue a bulk sale from its cursor.
+     *
+     * @param token_name - NFT name.
+     * @param max_rows - The maximum number of items to be scanned in this call.
+     */
+    [[eosio::action]] void bulkcrank(const name& token_name, const uint64_t& max_rows);
+
+    /**
+     * Cancel a bulk sale.Items listed already stay listed.
+     *
+     * @param caller - Account who send the transaction.Used as permission check(same as `closesale`).
+     * @param token_name - NFT name.
+     */
+    [[eosio::action]] void cancelbulk(const name& caller, const name& token_name);
+
+    /**
+     * Erase expired fixed price listings,at most `max_rows` per call.Anyone can call it.
+     *
+     * @param max_rows - The maximum number of listings to be erased in this call.
+     */
+    [[eosio::action]] void sweep(const uint64_t& max_rows);
+
+    /**
+     * Get the cheapest listing of a collection priced in `sym` of `token`.
+     *
+     * @param token_name - NFT name.
+     * @param token - Token contract of the price.
+     * @param sym - Symbol of the price.
+     */
+    [[eosio::action, eosio::read_only]] sale_list floor(const name& token_name, const name& token, const symbol& sym);
+
+    /**
+     * Get listings of a collection priced in `sym` of `token`,sorted by price ascending.
+     *
+     * @param token_name - NFT name.
+     * @param token - Token contract of the price.
+     * @param sym - Symbol of the price.
+     * @param max_price - Only listings with price amount <= max_price are returned.
+     * @param cursor - `next_cursor` of the previous page,0 for the first page.
+     * Start from the cheapest listing if the cursor listing is gone.
+     * @param limit - The maximum number of rows returned(<= 100).
+     */
+    [[eosio::action, eosio::read_only]] listing_page listings(const name& token_name,
+                                                              const name& token,
+                                                              const symbol& sym,
+                                                              const uint64_t& max_price,
+                                                              const uint64_t& cursor,
+                                                              const uint64_t& limit);
+
     void mtransfer(const name& contract, const structs::trx_tb& tx);
 
+    /**
+     * Receive all NFT transfers of this contract
+     */
+    void mtransfernft(const name& contract, const structs::trx_nft_tb& tx);
+
 private:
     void _check(const name& act, const name& caller);
     void _require_config();
     dsconf _get_config();
-    void split_memo(vector<string> & results, string memo, char separator);
+    asset _dutch_price(const dutch_list& d);
+    bool _is_listed(const uint64_t& nft_id);
+    bool _is_expired(const sale_list& s);
+    bool _in_book(const sale_list& s, const name& token_name, const name& token, const symbol& sym);
+    void _check_expires_at(const uint32_t& expires_at);
+    void _bid(const name& contract, const structs::trx_tb& tx, const uint64_t& nft_id);
+    void _add_refund(const name& owner, const name& token, const asset& quantity);
+    void _offer(const name& contract, const structs::trx_tb& tx, const name& token_name);
+    bool _match_offer(const dsconf& conf, const uint64_t& nft_id, const name& token_name, const name& token, const asset& price);
+    void _fill_offer(const dsconf& conf, const offers& o, const uint64_t& nft_id, const asset& price);
+    void _run_bulk_sale(const dsconf& conf, const name& token_name, const uint64_t& max_rows);
+    void _send_nft(const dsconf& conf, const name& to, const vector<uint64_t>& ids, const string& memo);
+    bool _is_operator(const dsconf& conf, const vector<uint64_t>& ids);
+    void _parse_ids(const string& memo, const size_t& offset, vector<uint64_t>& ids);
+    void _parse_price(const string& memo, const size_t& offset, name& token, asset& price);
+    void _return_nft(const dsconf& conf, const name& to, const uint64_t& nft_id, const string& memo);
+    bool _nft_exists(const dsconf& conf, const uint64_t& nft_id);
 };
 
 extern "C" {
@@ -89,11 +458,18 @@ void apply(uint64_t receiver, uint64_t code, uint64_t action) {
         return;
     }
 
+    if (action == name("transfernft").value && code != receiver) {
+        nftmarket thiscontract(name(receiver), name(code), datastream<const char*>("", 0));
+        auto trx = unpack_action_data<structs::trx_nft_tb>();
+        thiscontract.mtransfernft(name(code), trx);
+        return;
+    }
+
     if (code != receiver)
         return;
 
     switch (action) {
-        EOSIO_DISPATCH_HELPER(nftmarket, (init)(sale)(closesale))
+        EOSIO_DISPATCH_HELPER(nftmarket, (init)(sale)(closesale)(dutchsale)(auction)(settle)(claimrefund)(cancellist)(canceloffer)(acceptoffer)(selloffer)(bulksale)(bulkcrank)(cancelbulk)(sweep)(floor)(listings))
     }
     eosio_exit(0);
 }
@@ -18,30 +18,40 @@ ACTION nftmarket::init(const name& nft_contract, const name& org_contract) {
 ACTION nftmarket::sale(const name& caller,
                      const name& token,
                      const vector<uint64_t>& nft_ids,
-                     const asset quantity) {
+                     const asset quantity,
+                     const binary_extension<uint32_t>& expires_at) {
     require_auth(caller);
     _check(VA_SALE, caller);
     _require_config();
     check(nft_ids.size() <= 20, CODE_10006);
     check(is_account(token), CODE_10007);
+    check(quantity.is_valid() && quantity.amount > 0, CODE_10011);
+    // proposals encoded before expiry existed have no expires_at
+    const uint32_t expires = expires_at.value_or();
+    _check_expires_at(expires);
 
     salelist_idx st(get_self(), get_self().value);
 
     auto conf = _get_config();
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
 
     for (auto const& id : nft_ids) {
-        check(st.find(id) == st.end(), CODE_10002);
+        check(!_is_listed(id), CODE_10002);
 
-        items_idx it(conf.nft_contract, conf.nft_contract.value);
         auto item_itr = it.find(id);
         check(item_itr != it.end(), CODE_10004);
         check(item_itr->owner == conf.org_contract, CODE_10005);
 
+        if (_match_offer(conf, id, item_itr->token_name, token, quantity))
+            continue;
+
         st.emplace(get_self(), [&](auto& m) {
             m.nft_id = id;
             m.owner = item_itr->owner;
             m.token = token;
             m.quantity = quantity;
+            m.token_name.emplace(item_itr->token_name);
+            m.expires_at.emplace(expires);
         });
     }
     require_recipient(LOG_REC);
@@ -55,58 +65,524 @@ ACTION nftmarket::closesale(const name& caller, const uint64_t& nft_id) {
 
     salelist_idx st(get_self(), get_self().value);
     auto itr = st.find(nft_id);
-    check(itr != st.end(), CODE_10004);
+    check(itr == st.end() || itr->owner == _get_config().org_contract, CODE_10005);
+    dutchlist_idx dt(get_self(), get_self().value);
+    auto ditr = dt.find(nft_id);
+    auction_idx at(get_self(), get_self().value);
+    auto aitr = at.find(nft_id);
+    if (itr != st.end()) {
+        st.erase(itr);
+    } else if (ditr != dt.end()) {
+        dt.erase(ditr);
+    } else {
+        check(aitr != at.end(), CODE_10004);
+        if (aitr->bidder != name { "" })
+            _add_refund(aitr->bidder, aitr->token, aitr->bid);
+        at.erase(aitr);
+    }
+
+    require_recipient(LOG_REC);
+}
+
+//JUST FOR ORG_CONTRACT
+ACTION nftmarket::dutchsale(const name& caller,
+                            const name& token,
+                            const vector<uint64_t>& nft_ids,
+                            const asset& start_price,
+                            const asset& end_price,
+                            const uint32_t& start_time,
+                            const uint32_t& end_time) {
+    require_auth(caller);
+    _check(VA_DUTCH_SALE, caller);
+    _require_config();
+    check(nft_ids.size() <= 20, CODE_10006);
+    check(is_account(token), CODE_10007);
+    check(end_price.is_valid() && end_price.amount > 0, CODE_10011);
+    check(start_price.symbol == end_price.symbol && start_price >= end_price, CODE_10011);
+    check(start_time < end_time && end_time > current_time_point().sec_since_epoch(), CODE_10018);
+
+    dutchlist_idx dt(get_self(), get_self().value);
+
+    auto conf = _get_config();
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+
+    for (auto const& id : nft_ids) {
+        check(!_is_listed(id), CODE_10002);
+
+        auto item_itr = it.find(id);
+        check(item_itr != it.end(), CODE_10004);
+        check(item_itr->owner == conf.org_contract, CODE_10005);
+
+        dt.emplace(get_self(), [&](auto& m) {
+            m.nft_id = id;
+            m.owner = item_itr->owner;
+            m.token = token;
+            m.start_price = start_price;
+            m.end_price = end_price;
+            m.start_time = start_time;
+            m.end_time = end_time;
+            m.token_name = item_itr->token_name;
+        });
+    }
+    require_recipient(LOG_REC);
+}
+
+//JUST FOR ORG_CONTRACT
+ACTION nftmarket::auction(const name& caller,
+                          const name& token,
+                          const uint64_t& nft_id,
+                          const asset& start_price,
+                          const uint32_t& end_time,
+                          const uint32_t& extend_sec) {
+    require_auth(caller);
+    _check(VA_AUCTION, caller);
+    _require_config();
+    check(is_account(token), CODE_10007);
+    check(start_price.is_valid() && start_price.amount > 0, CODE_10011);
+    check(end_time > current_time_point().sec_since_epoch(), CODE_10018);
+    check(!_is_listed(nft_id), CODE_10002);
+
+    auto conf = _get_config();
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    auto item_itr = it.find(nft_id);
+    check(item_itr != it.end(), CODE_10004);
+    check(item_itr->owner == conf.org_contract, CODE_10005);
+
+    auction_idx at(get_self(), get_self().value);
+    at.emplace(get_self(), [&](auto& m) {
+        m.nft_id = nft_id;
+        m.owner = item_itr->owner;
+        m.token = token;
+        m.start_price = start_price;
+        m.bidder = name { "" };
+        m.bid = asset(0, start_price.symbol);
+        m.end_time = end_time;
+        m.extend_sec = extend_sec;
+        m.token_name = item_itr->token_name;
+    });
+    require_recipient(LOG_REC);
+}
+
+ACTION nftmarket::settle(const uint64_t& nft_id) {
+    _require_config();
+
+    auction_idx at(get_self(), get_self().value);
+    auto itr = at.find(nft_id);
+    check(itr != at.end(), CODE_10020);
+    check(current_time_point().sec_since_epoch() >= itr->end_time, CODE_10022);
+
+    if (itr->bidder != name { "" }) {
+        auto conf = _get_config();
+        items_idx it(conf.nft_contract, conf.nft_contract.value);
+        auto item_itr = it.find(nft_id);
+        if (item_itr == it.end() || item_itr->owner != conf.org_contract) {
+            // the NFT can not be delivered any more
+            _add_refund(itr->bidder, itr->token, itr->bid);
+        } else {
+            const string memo = string("auction-") + std::to_string(nft_id);
+
+            // IN
+            action(permission_level { get_self(), name("active") },
+                   itr->token, name("transfer"),
+                   std::make_tuple(get_self(), conf.org_contract, itr->bid, memo))
+                .send();
+
+            // OUT
+            _send_nft(conf, itr->bidder, vector<uint64_t> { nft_id }, memo);
+        }
+    }
+    at.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nftmarket::claimrefund(const name& account) {
+    require_auth(account);
 
+    refund_idx rt(get_self(), account.value);
+    auto itr = rt.begin();
+    check(itr != rt.end(), CODE_10032);
+    while (itr != rt.end()) {
+        action(permission_level { get_self(), name("active") },
+               itr->token, name("transfer"),
+               std::make_tuple(get_self(), account, itr->balance, string("refund")))
+            .send();
+        itr = rt.erase(itr);
+    }
+}
+
+ACTION nftmarket::cancellist(const name& seller, const uint64_t& nft_id) {
+    require_auth(seller);
+    _require_config();
+
+    salelist_idx st(get_self(), get_self().value);
+    auto itr = st.find(nft_id);
+    check(itr != st.end(), CODE_10004);
+    check(itr->owner == seller, CODE_10031);
     st.erase(itr);
 
+    auto conf = _get_config();
+    if (_nft_exists(conf, nft_id))
+        _return_nft(conf, seller, nft_id, "cancel list");
+
     require_recipient(LOG_REC);
 }
 
+ACTION nftmarket::canceloffer(const name& buyer, const uint64_t& offer_id) {
+    require_auth(buyer);
+
+    offer_idx ot(get_self(), get_self().value);
+    auto itr = ot.find(offer_id);
+    check(itr != ot.end() && itr->buyer == buyer, CODE_10027);
+
+    action(permission_level { get_self(), name("active") },
+           itr->token, name("transfer"),
+           std::make_tuple(get_self(), buyer, itr->quantity, string("cancel offer")))
+        .send();
+    ot.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+//JUST FOR ORG_CONTRACT
+ACTION nftmarket::acceptoffer(const name& caller, const uint64_t& offer_id, const uint64_t& nft_id) {
+    require_auth(caller);
+    _check(VA_ACCEPT_OFFER, caller);
+    _require_config();
+
+    offer_idx ot(get_self(), get_self().value);
+    auto itr = ot.find(offer_id);
+    check(itr != ot.end(), CODE_10027);
+
+    auto conf = _get_config();
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    auto item_itr = it.find(nft_id);
+    check(item_itr != it.end(), CODE_10004);
+    check(item_itr->owner == conf.org_contract, CODE_10005);
+    check(item_itr->token_name == itr->token_name, CODE_10029);
+
+    // a fixed price listing of the item is replaced by the sale
+    salelist_idx st(get_self(), get_self().value);
+    auto sitr = st.find(nft_id);
+    if (sitr != st.end())
+        st.erase(sitr);
+    check(!_is_listed(nft_id), CODE_10002);
+
+    _fill_offer(conf, *itr, nft_id, itr->quantity);
+    ot.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nftmarket::selloffer(const name& owner, const uint64_t& offer_id, const uint64_t& nft_id) {
+    require_auth(owner);
+    _require_config();
+
+    offer_idx ot(get_self(), get_self().value);
+    auto itr = ot.find(offer_id);
+    check(itr != ot.end(), CODE_10027);
+
+    auto conf = _get_config();
+    check(owner != conf.org_contract, CODE_10033);
+
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    auto item_itr = it.find(nft_id);
+    check(item_itr != it.end(), CODE_10004);
+    check(item_itr->token_name == itr->token_name, CODE_10029);
+
+    const string memo = string("offer-") + std::to_string(offer_id);
+
+    salelist_idx st(get_self(), get_self().value);
+    auto sitr = st.find(nft_id);
+    if (sitr != st.end()) {
+        // escrowed by a peer-to-peer listing of owner
+        check(sitr->owner == owner, CODE_10031);
+        st.erase(sitr);
+        _return_nft(conf, itr->buyer, nft_id, memo);
+    } else {
+        check(item_itr->owner == owner, CODE_10034);
+        check(!_is_listed(nft_id), CODE_10002);
+
+        // as an approved operator of owner
+        action(permission_level { get_self(), name("active") },
+               conf.nft_contract, name("transfernft"),
+               std::make_tuple(owner, itr->buyer, vector<uint64_t> { nft_id }, memo))
+            .send();
+    }
+
+    action(permission_level { get_self(), name("active") },
+           itr->token, name("transfer"),
+           std::make_tuple(get_self(), owner, itr->quantity, memo))
+        .send();
+    ot.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+//JUST FOR ORG_CONTRACT
+ACTION nftmarket::bulksale(const name& caller,
+                           const name& token,
+                           const name& token_name,
+                           const uint64_t& start_id,
+                           const uint64_t& end_id,
+                           const asset& quantity,
+                           const uint32_t& expires_at,
+                           const uint64_t& max_rows) {
+    require_auth(caller);
+    _check(VA_SALE, caller);
+    _require_config();
+    check(is_account(token), CODE_10007);
+    check(quantity.is_valid() && quantity.amount > 0, CODE_10011);
+    _check_expires_at(expires_at);
+    check(start_id <= end_id, CODE_10017);
+    check(max_rows > 0, CODE_10016);
+
+    bulksale_idx bt(get_self(), get_self().value);
+    check(bt.find(token_name.value) == bt.end(), CODE_10014);
+    bt.emplace(get_self(), [&](auto& m) {
+        m.token_name = token_name;
+        m.token = token;
+        m.quantity = quantity;
+        m.next_id = start_id;
+        m.end_id = end_id;
+        m.expires_at = expires_at;
+    });
+
+    _run_bulk_sale(_get_config(), token_name, max_rows);
+    require_recipient(LOG_REC);
+}
+
+ACTION nftmarket::bulkcrank(const name& token_name, const uint64_t& max_rows) {
+    _require_config();
+    check(max_rows > 0, CODE_10016);
+
+    _run_bulk_sale(_get_config(), token_name, max_rows);
+    require_recipient(LOG_REC);
+}
+
+//JUST FOR ORG_CONTRACT
+ACTION nftmarket::cancelbulk(const name& caller, const name& token_name) {
+    require_auth(caller);
+    _check(VA_CLOSE_SALE, caller);
+    _require_config();
+
+    bulksale_idx bt(get_self(), get_self().value);
+    auto itr = bt.find(token_name.value);
+    check(itr != bt.end(), CODE_10015);
+    bt.erase(itr);
+
+    require_recipient(LOG_REC);
+}
+
+ACTION nftmarket::sweep(const uint64_t& max_rows) {
+    _require_config();
+    check(max_rows > 0, CODE_10016);
+
+    salelist_idx st(get_self(), get_self().value);
+    auto idx = st.get_index<name("byexpiry")>();
+    auto itr = idx.begin();
+
+    auto conf = _get_config();
+    const uint64_t now = current_time_point().sec_since_epoch();
+    uint64_t erased = 0;
+    while (itr != idx.end() && itr->by_expiry() <= now && erased < max_rows) {
+        if (itr->owner != conf.org_contract && _nft_exists(conf, itr->nft_id))
+            _return_nft(conf, itr->owner, itr->nft_id, "expired");
+        itr = idx.erase(itr);
+        erased++;
+    }
+}
+
+nftmarket::sale_list nftmarket::floor(const name& token_name, const name& token, const symbol& sym) {
+    salelist_idx st(get_self(), get_self().value);
+    auto idx = st.get_index<name("bycollprice")>();
+    auto itr = idx.lower_bound(checksum256::make_from_word_sequence<uint64_t>(token_name.value, token.value, sym.raw(), 0ULL));
+    while (itr != idx.end() && _in_book(*itr, token_name, token, sym) && _is_expired(*itr)) {
+        itr++;
+    }
+    check(itr != idx.end() && _in_book(*itr, token_name, token, sym), CODE_10012);
+    return *itr;
+}
+
+nftmarket::listing_page nftmarket::listings(const name& token_name,
+                                            const name& token,
+                                            const symbol& sym,
+                                            const uint64_t& max_price,
+                                            const uint64_t& cursor,
+                                            const uint64_t& limit) {
+    check(limit <= 100, CODE_10013);
+
+    salelist_idx st(get_self(), get_self().value);
+    auto idx = st.get_index<name("bycollprice")>();
+    auto itr = idx.lower_bound(checksum256::make_from_word_sequence<uint64_t>(token_name.value, token.value, sym.raw(), 0ULL));
+
+    if (cursor > 0) {
+        auto citr = st.find(cursor - 1);
+        if (citr != st.end() && _in_book(*citr, token_name, token, sym))
+            itr = idx.iterator_to(*citr);
+    }
+
+    listing_page page;
+    page.more = false;
+    page.next_cursor = 0;
+    while (itr != idx.end() && _in_book(*itr, token_name, token, sym) && (uint64_t)itr->quantity.amount <= max_price) {
+        if (page.rows.size() >= limit) {
+            page.more = true;
+            page.next_cursor = itr->nft_id + 1;
+            break;
+        }
+        if (!_is_expired(*itr))
+            page.rows.emplace_back(*itr);
+        itr++;
+    }
+    return page;
+}
+
 ACTION nftmarket::mtransfer(const name& contract, const structs::trx_tb& tx) {
     if (tx.from == get_self() || tx.to != get_self())
         return;
 
+    vector<uint64_t> ids;
+
+    //format: bid-id
+    if (tx.memo.compare(0, 4, "bid-") == 0) {
+        _parse_ids(tx.memo, 4, ids);
+        check(ids.size() == 1, CODE_10008);
+        _bid(contract, tx, ids[0]);
+        return;
+    }
+
+    //format: offer-token_name
+    if (tx.memo.compare(0, 6, "offer-") == 0) {
+        name token_name;
+        check(memo::parse_name(string_view(tx.memo).substr(6), token_name), CODE_10008);
+        _offer(contract, tx, token_name);
+        return;
+    }
+
     //if start with `buy-`
     //format: buy-id1-id2-id3...
-    bool buy_action = (int)tx.memo[0] == 98 && (int)tx.memo[1] == 117 && (int)tx.memo[2] == 121 && (int)tx.memo[3] == 45;
-    if (!buy_action)
+    if (tx.memo.compare(0, 4, "buy-") != 0)
         return;
 
-    vector<string> vec;
-    split_memo(vec, tx.memo, '-');
-    check(vec.size() > 1, CODE_10008);
+    _parse_ids(tx.memo, 4, ids);
 
-    vector<uint64_t> ids;
+    auto conf = _get_config();
     salelist_idx st(get_self(), get_self().value);
+    dutchlist_idx dt(get_self(), get_self().value);
 
-    //first one is `buy-`
+    // org_contract items and escrowed items of sellers
+    vector<uint64_t> org_ids;
+    vector<uint64_t> escrow_ids;
     asset price = asset(0, tx.quantity.symbol);
-    for (int i = 1; i < vec.size(); i++) {
-        auto id = stoll(vec[i]);
+    asset org_price = asset(0, tx.quantity.symbol);
+    bool has_dutch = false;
+    for (auto const& id : ids) {
         auto itr = st.find(id);
-        check(itr != st.end(), CODE_10004);
-        check(itr->token == contract, CODE_10009);
-        check(itr->quantity.symbol == tx.quantity.symbol, CODE_10010);
+        if (itr != st.end()) {
+            check(itr->token == contract, CODE_10009);
+            check(itr->quantity.symbol == tx.quantity.symbol, CODE_10010);
+            check(!_is_expired(*itr), CODE_10025);
 
-        price += itr->quantity;
-        st.erase(itr);
-        ids.emplace_back(id);
+            price += itr->quantity;
+            if (itr->owner == conf.org_contract) {
+                org_price += itr->quantity;
+                org_ids.emplace_back(id);
+            } else {
+                // proceeds go to the seller directly
+                action(permission_level { get_self(), name("active") },
+                       contract, name("transfer"),
+                       std::make_tuple(get_self(), itr->owner, itr->quantity, string("sold-") + std::to_string(id)))
+                    .send();
+                escrow_ids.emplace_back(id);
+            }
+            st.erase(itr);
+        } else {
+            auto ditr = dt.find(id);
+            check(ditr != dt.end(), CODE_10004);
+            check(ditr->token == contract, CODE_10009);
+            check(ditr->start_price.symbol == tx.quantity.symbol, CODE_10010);
+            check(current_time_point().sec_since_epoch() >= ditr->start_time, CODE_10019);
+
+            const asset dutch_price = _dutch_price(*ditr);
+            price += dutch_price;
+            org_price += dutch_price;
+            org_ids.emplace_back(id);
+            dt.erase(ditr);
+            has_dutch = true;
+        }
     }
-    check(price == tx.quantity, CODE_10010);
 
-    auto conf = _get_config();
+    // the dutch price may fall while the transaction is pending
+    if (has_dutch)
+        check(price <= tx.quantity, CODE_10010);
+    else
+        check(price == tx.quantity, CODE_10010);
 
     // IN
-    action(permission_level { get_self(), name("active") },
-           contract, name("transfer"),
-           std::make_tuple(get_self(), conf.org_contract, tx.quantity, tx.memo))
-        .send();
+    if (org_price.amount > 0) {
+        action(permission_level { get_self(), name("active") },
+               contract, name("transfer"),
+               std::make_tuple(get_self(), conf.org_contract, org_price, tx.memo))
+            .send();
+    }
+
+    if (price < tx.quantity) {
+        action(permission_level { get_self(), name("active") },
+               contract, name("transfer"),
+               std::make_tuple(get_self(), tx.from, tx.quantity - price, string("refund")))
+            .send();
+    }
 
     // OUT
-    action(permission_level { get_self(), name("active") },
-           conf.org_contract, name("approvenft"),
-           std::make_tuple(get_self(), conf.nft_contract, tx.from, ids, tx.memo))
-        .send();
+    if (org_ids.size() > 0)
+        _send_nft(conf, tx.from, org_ids, tx.memo);
+    if (escrow_ids.size() > 0) {
+        action(permission_level { get_self(), name("active") },
+               conf.nft_contract, name("transfernft"),
+               std::make_tuple(get_self(), tx.from, escrow_ids, tx.memo))
+            .send();
+    }
+
+    require_recipient(LOG_REC);
+}
+
+void nftmarket::mtransfernft(const name& contract, const structs::trx_nft_tb& tx) {
+    if (tx.from == get_self() || tx.to != get_self())
+        return;
+
+    // revert instead of keeping a NFT that can not be listed
+    _require_config();
+    auto conf = _get_config();
+    check(contract == conf.nft_contract, CODE_10035);
+
+    //format: list:token_contract:price
+    check(tx.memo.compare(0, 5, "list:") == 0, CODE_10008);
+    check(tx.from != conf.org_contract, CODE_10030);
+    check(tx.ids.size() <= 20, CODE_10006);
+
+    name token;
+    asset price;
+    _parse_price(tx.memo, 5, token, price);
+    check(is_account(token), CODE_10007);
+    check(price.is_valid() && price.amount > 0, CODE_10011);
+
+    salelist_idx st(get_self(), get_self().value);
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    for (auto const& id : tx.ids) {
+        check(!_is_listed(id), CODE_10002);
+        auto item_itr = it.find(id);
+        check(item_itr != it.end(), CODE_10004);
+
+        st.emplace(get_self(), [&](auto& m) {
+            m.nft_id = id;
+            m.owner = tx.from;
+            m.token = token;
+            m.quantity = price;
+            m.token_name.emplace(item_itr->token_name);
+            m.expires_at.emplace(0);
+        });
+    }
 
     require_recipient(LOG_REC);
 }
@@ -126,22 +602,250 @@ nftmarket::dsconf nftmarket::_get_config() {
     return ct.get();
 }
 
-void nftmarket::split_memo(vector<string>& results, string memo, char separator) {
-    auto start_inx = memo.cbegin();
-    auto end_inx = memo.cend();
-    bool is_empty_str_last = false;
-    size_t len = memo.size();
-    size_t index = 0;
-    for (auto it = start_inx; it != end_inx; ++it) {
-        if (*it == separator) {
-            results.emplace_back(start_inx, it);
-            start_inx = it + 1;
-            is_empty_str_last = index == len - 1;
+asset nftmarket::_dutch_price(const dutch_list& d) {
+    const uint32_t now = current_time_point().sec_since_epoch();
+    if (now <= d.start_time)
+        return d.start_price;
+    if (now >= d.end_time)
+        return d.end_price;
+
+    const uint128_t range = d.start_price.amount - d.end_price.amount;
+    const uint64_t drop = range * (now - d.start_time) / (d.end_time - d.start_time);
+    return asset(d.start_price.amount - drop, d.start_price.symbol);
+}
+
+bool nftmarket::_is_listed(const uint64_t& nft_id) {
+    salelist_idx st(get_self(), get_self().value);
+    if (st.find(nft_id) != st.end())
+        return true;
+
+    dutchlist_idx dt(get_self(), get_self().value);
+    if (dt.find(nft_id) != dt.end())
+        return true;
+
+    auction_idx at(get_self(), get_self().value);
+    return at.find(nft_id) != at.end();
+}
+
+bool nftmarket::_is_expired(const sale_list& s) {
+    return s.by_expiry() <= current_time_point().sec_since_epoch();
+}
+
+bool nftmarket::_in_book(const sale_list& s, const name& token_name, const name& token, const symbol& sym) {
+    return s.token_name.value_or() == token_name && s.token == token && s.quantity.symbol == sym;
+}
+
+void nftmarket::_check_expires_at(const uint32_t& expires_at) {
+    check(expires_at == 0 || expires_at > current_time_point().sec_since_epoch(), CODE_10026);
+}
+
+void nftmarket::_bid(const name& contract, const structs::trx_tb& tx, const uint64_t& nft_id) {
+    auction_idx at(get_self(), get_self().value);
+    auto itr = at.find(nft_id);
+    check(itr != at.end(), CODE_10020);
+    check(itr->token == contract, CODE_10009);
+    check(itr->start_price.symbol == tx.quantity.symbol, CODE_10010);
+
+    const uint32_t now = current_time_point().sec_since_epoch();
+    check(now < itr->end_time, CODE_10021);
+
+    const bool has_bid = itr->bidder != name { "" };
+    if (has_bid) {
+        const int64_t increment = std::max(itr->bid.amount * (int64_t)MIN_BID_INCREMENT / 100, (int64_t)1);
+        check(tx.quantity.amount >= itr->bid.amount + increment, CODE_10023);
+
+        // a failing transfer to the outbid bidder must not block new bids
+        _add_refund(itr->bidder, contract, itr->bid);
+    } else {
+        check(tx.quantity >= itr->start_price, CODE_10023);
+    }
+
+    at.modify(itr, same_payer, [&](auto& m) {
+        m.bidder = tx.from;
+        m.bid = tx.quantity;
+        if (now + m.extend_sec > m.end_time)
+            m.end_time = now + m.extend_sec;
+    });
+
+    require_recipient(LOG_REC);
+}
+
+void nftmarket::_add_refund(const name& owner, const name& token, const asset& quantity) {
+    refund_idx rt(get_self(), owner.value);
+    auto idx = rt.get_index<name("bytokensym")>();
+    auto itr = idx.find((uint128_t)token.value << 64 | quantity.symbol.raw());
+    if (itr == idx.end()) {
+        rt.emplace(get_self(), [&](auto& m) {
+            m.id = rt.available_primary_key();
+            m.token = token;
+            m.balance = quantity;
+        });
+    } else {
+        idx.modify(itr, same_payer, [&](auto& m) {
+            m.balance += quantity;
+        });
+    }
+}
+
+void nftmarket::_offer(const name& contract, const structs::trx_tb& tx, const name& token_name) {
+    check(tx.quantity.is_valid() && tx.quantity.amount > 0, CODE_10010);
+
+    auto conf = _get_config();
+    stats_idx nst(conf.nft_contract, conf.nft_contract.value);
+    check(nst.find(token_name.value) != nst.end(), CODE_10028);
+
+    offer_idx ot(get_self(), get_self().value);
+    ot.emplace(get_self(), [&](auto& m) {
+        m.id = ot.available_primary_key();
+        m.buyer = tx.from;
+        m.token = contract;
+        m.quantity = tx.quantity;
+        m.token_name = token_name;
+    });
+
+    require_recipient(LOG_REC);
+}
+
+bool nftmarket::_match_offer(const dsconf& conf, const uint64_t& nft_id, const name& token_name, const name& token, const asset& price) {
+    offer_idx ot(get_self(), get_self().value);
+    auto idx = ot.get_index<name("bycollprice")>();
+    auto itr = idx.lower_bound(checksum256::make_from_word_sequence<uint64_t>(token_name.value, token.value, price.symbol.raw(), 0ULL));
+
+    // the first offer in the same token and symbol is the best one
+    if (itr == idx.end() || itr->token_name != token_name || itr->token != token || itr->quantity.symbol != price.symbol)
+        return false;
+    if (itr->quantity < price)
+        return false;
+
+    _fill_offer(conf, *itr, nft_id, price);
+    idx.erase(itr);
+    return true;
+}
+
+void nftmarket::_fill_offer(const dsconf& conf, const offers& o, const uint64_t& nft_id, const asset& price) {
+    const string memo = string("offer-") + std::to_string(o.id);
+
+    // IN
+    action(permission_level { get_self(), name("active") },
+           o.token, name("transfer"),
+           std::make_tuple(get_self(), conf.org_contract, price, memo))
+        .send();
+
+    if (price < o.quantity) {
+        action(permission_level { get_self(), name("active") },
+               o.token, name("transfer"),
+               std::make_tuple(get_self(), o.buyer, o.quantity - price, string("refund")))
+            .send();
+    }
+
+    // OUT
+    _send_nft(conf, o.buyer, vector<uint64_t> { nft_id }, memo);
+}
+
+void nftmarket::_run_bulk_sale(const dsconf& conf, const name& token_name, const uint64_t& max_rows) {
+    bulksale_idx bt(get_self(), get_self().value);
+    auto bitr = bt.find(token_name.value);
+    check(bitr != bt.end(), CODE_10015);
+
+    salelist_idx st(get_self(), get_self().value);
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    auto idx = it.get_index<name("bytoken")>();
+    auto itr = idx.lower_bound((uint128_t)token_name.value << 64 | bitr->next_id);
+
+    // items of other owners are skipped but still count as scanned
+    uint64_t scanned = 0;
+    while (itr != idx.end() && itr->token_name == token_name && itr->id <= bitr->end_id && scanned < max_rows) {
+        if (itr->owner == conf.org_contract && !_is_listed(itr->id)
+            && !_match_offer(conf, itr->id, token_name, bitr->token, bitr->quantity)) {
+            st.emplace(get_self(), [&](auto& m) {
+                m.nft_id = itr->id;
+                m.owner = itr->owner;
+                m.token = bitr->token;
+                m.quantity = bitr->quantity;
+                m.token_name.emplace(token_name);
+                m.expires_at.emplace(bitr->expires_at);
+            });
         }
-        index++;
+        scanned++;
+        itr++;
     }
-    if (start_inx != end_inx)
-        results.emplace_back(start_inx, end_inx);
-    if (is_empty_str_last)
-        results.emplace_back(string(""));
-}
\ No newline at end of file
+
+    if (itr == idx.end() || itr->token_name != token_name || itr->id > bitr->end_id) {
+        bt.erase(bitr);
+    } else {
+        bt.modify(bitr, same_payer, [&](auto& m) {
+            m.next_id = itr->id;
+        });
+    }
+}
+
+void nftmarket::_send_nft(const dsconf& conf, const name& to, const vector<uint64_t>& ids, const string& memo) {
+    if (_is_operator(conf, ids)) {
+        // approved by org_contract,transfer directly
+        action(permission_level { get_self(), name("active") },
+               conf.nft_contract, name("transfernft"),
+               std::make_tuple(conf.org_contract, to, ids, memo))
+            .send();
+    } else {
+        action(permission_level { get_self(), name("active") },
+               conf.org_contract, name("approvenft"),
+               std::make_tuple(get_self(), conf.nft_contract, to, ids, memo))
+            .send();
+    }
+}
+
+bool nftmarket::_is_operator(const dsconf& conf, const vector<uint64_t>& ids) {
+    operator_idx ot(conf.nft_contract, conf.org_contract.value);
+    auto idx = ot.get_index<name("byaccttoken")>();
+    auto itr = idx.lower_bound((uint128_t)get_self().value << 64);
+    if (itr == idx.end() || itr->account != get_self())
+        return false;
+
+    // sorted by token_name,an empty name approves all NFTs
+    if (itr->token_name == name { "" })
+        return true;
+
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    for (auto const& id : ids) {
+        auto item_itr = it.find(id);
+        check(item_itr != it.end(), CODE_10004);
+        if (idx.find((uint128_t)get_self().value << 64 | item_itr->token_name.value) == idx.end())
+            return false;
+    }
+    return true;
+}
+
+void nftmarket::_return_nft(const dsconf& conf, const name& to, const uint64_t& nft_id, const string& memo) {
+    action(permission_level { get_self(), name("active") },
+           conf.nft_contract, name("transfernft"),
+           std::make_tuple(get_self(), to, vector<uint64_t> { nft_id }, memo))
+        .send();
+}
+
+// an escrowed NFT can still be burned by its issuer
+bool nftmarket::_nft_exists(const dsconf& conf, const uint64_t& nft_id) {
+    items_idx it(conf.nft_contract, conf.nft_contract.value);
+    return it.find(nft_id) != it.end();
+}
+
+void nftmarket::_parse_price(const string& memo, const size_t& offset, name& token, asset& price) {
+    // token_contract:amount SYMBOL, e.g. eosio.token:1.0000 EOS
+    const string_view v = string_view(memo).substr(offset);
+    const size_t sep = v.find(':');
+    check(sep != string_view::npos, CODE_10008);
+    check(memo::parse_name(v.substr(0, sep), token), CODE_10008);
+    check(memo::parse_asset(v.substr(sep + 1), price), CODE_10008);
+}
+
+void nftmarket::_parse_ids(const string& memo, const size_t& offset, vector<uint64_t>& ids) {
+    // decode ids from views into the memo,one pass and no temporary strings
+    check(memo.size() > offset && memo.size() <= MAX_MEMO_SIZE, CODE_10008);
+
+    array<string_view, MAX_BUY_IDS> parts;
+    size_t count;
+    check(memo::split(string_view(memo).substr(offset), '-', parts, count), CODE_10024);
+
+    ids.resize(count);
+    for (size_t i = 0; i < count; i++)
+        check(memo::parse_u64(parts[i], ids[i]), CODE_10008);
+}
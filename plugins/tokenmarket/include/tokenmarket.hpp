@@ -1,62 +1,115 @@
 #pragma once
-#include "../../../lib/assets.hpp"
-#include "../../../lib/auths.hpp"
 #include "../../../lib/consts.hpp"
-#include "../../../lib/safemath.hpp"
-#include "../../../lib/structs.hpp"
-#include <math.h>
+#include "../../../lib/converter.hpp"
+#include "../../../lib/memo.hpp"
+#include "../../../lib/merkle.hpp"
 
 using namespace std;
 using namespace eosio;
 
-#define CODE_10000 "invalid max_quantity value"
-#define CODE_10001 "ins can not be empty"
-#define CODE_10002 "invalid rate value"
-#define CODE_10003 "token exists already"
-#define CODE_10004 "exchange in data does not exist"
-#define CODE_10005 "config does not exists; initialization is required"
-#define CODE_10006 "config has initialized"
-#define CODE_10007 "overdrawn balance"
+// CODE_10000 - CODE_10007 are defined in converter.hpp
+#define CODE_10008 "parse memo error"
+#define CODE_10009 "invalid price"
+#define CODE_10010 "order does not exist"
+#define CODE_10011 "token is not accepted"
+#define CODE_10012 "invalid order quantity"
+#define CODE_10013 "curve requires limit config"
+#define CODE_10014 "curve does not exist"
+#define CODE_10015 "invalid curve value"
+#define CODE_10016 "nothing to claim"
+#define CODE_10017 "invalid max_rows value"
+#define CODE_10018 "invalid allowlist proof"
+#define CODE_10019 "account is not allowlisted"
+#define CODE_10020 "allocation exceeded"
 
 CONTRACT tokenmarket : public contract {
 public:
     using contract::contract;
 
     tokenmarket(eosio::name receiver, eosio::name code, datastream<const char*> ds)
-        : contract(receiver, code, ds) { }
+        : contract(receiver, code, ds), conv(receiver) { }
 
-    // singleton
-    TABLE dsconf {
+    using dsconf = converter::dsconf;
+    using exchange_in = converter::exchange_in;
+
+    // scope is self
+    // linear bonding curve of an `exchangein` token,both values are BASE_SCALE
+    // price(sold) = (base_price + slope * sold) / BASE_SCALE,quote raw per org token raw
+    TABLE curves {
         name token;
-        bool limit;
-        asset max_quantity;
-        asset remaining_quantity;
-        name org_contract;
+        uint64_t base_price;
+        uint64_t slope;
+
+        uint64_t primary_key() const { return token.value; }
     };
 
-    // scope is self
-    TABLE exchange_in {
+    // scope is owner
+    // self: org token inventory deposited by org_contract for payouts
+    // buyer: claimable org token
+    // org_contract: receivable accepted tokens
+    TABLE ledger {
         name token;
-        symbol_code symbol_code;
-        uint64_t rate; //BASE_SCALE
+        asset balance;
 
         uint64_t primary_key() const { return token.value; }
     };
 
-    using dsconf_idx = singleton<"dsconf"_n, dsconf>;
-    using exin_idx = multi_index<"exchangein"_n, exchange_in>;
+    // scope is quote token contract
+    // price is the quote amount(raw) per 1 org token(10^precision raw)
+    TABLE orders {
+        uint64_t id;
+        name owner;
+        bool is_bid;
+        uint64_t price;
+        asset quantity; // escrowed,quote for bids and org token for asks
+        uint32_t created_at;
+        name escrow_token; // contract of quantity,refunded from it even if the org token changes
+        uint64_t allocated; // bids: allowlist allocation reserved and not filled yet(raw org token)
+
+        uint64_t primary_key() const { return id; }
+        // best price first,then oldest first
+        uint128_t by_price() const { return (uint128_t)(is_bid ? UINT64_MAX - price : price) << 64 | id; }
+    };
+
+    using dsconf_idx = converter::dsconf_idx;
+    using exin_idx = converter::exin_idx;
+    using ledger_idx = multi_index<"ledger"_n, ledger>;
+    // singleton
+    // merkle root of the (account, max_allocation) leaves,exchanges are open to all without it
+    TABLE allowlist {
+        checksum256 root;
+    };
 
-    //0.0 = 0
-    //0.01 = 10^10
-    //0.10 = 10^11
-    //1.00 = 10^12
-    //10.0 = 10^13
-    //...
-    const uint64_t BASE_SCALE = 1000000000000; //10^12
+    // scope is self
+    // created by `prove` when the buyer participates
+    TABLE allocations {
+        name account;
+        checksum256 root;
+        uint64_t max_allocation; // raw amount of org token
+        uint64_t used;
+
+        uint64_t primary_key() const { return account.value; }
+    };
+
+    using curve_idx = multi_index<"curve"_n, curves>;
+    using allowlist_idx = singleton<"allowlist"_n, allowlist>;
+    using allocation_idx = multi_index<"allocation"_n, allocations>;
+    using bids_idx = multi_index<"bids"_n, orders,
+                                 indexed_by<"byprice"_n, const_mem_fun<orders, uint128_t, &orders::by_price>>>;
+    using asks_idx = multi_index<"asks"_n, orders,
+                                 indexed_by<"byprice"_n, const_mem_fun<orders, uint128_t, &orders::by_price>>>;
+
+    const uint64_t BASE_SCALE = converter::BASE_SCALE;
+
+    // matched orders per incoming order
+    const uint64_t MAX_FILLS = 20;
 
     const name VA_CHANGE_CONF = name("changeconf");
     const name VA_ADD_EXIN = name("addexin");
     const name VA_REMOVE_EXIN = name("rmexin");
+    const name VA_SET_CURVE = name("setcurve");
+    const name VA_WITHDRAW_INV = name("withdrawinv");
+    const name VA_SET_ALLOWLIST = name("setallowlist");
 
     /**
      * Initial contract to save the config.
@@ -107,18 +160,101 @@ public:
      */
     [[eosio::action]] void rmexin(const name& caller, const name& token);
 
+    /**
+     * Sell along a linear bonding curve instead of the fixed `rate` of an accepted token.
+     * The curve position is the sold quantity(max_quantity - remaining_quantity),so `limit` is required.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Acceptable asset contract.
+     * @param base_price - Price of the first org token raw unit.1 = 10^12
+     * @param slope - Price increase per org token raw unit sold.1 = 10^12
+     */
+    [[eosio::action]] void setcurve(const name& caller,
+                                    const name& token,
+                                    const uint64_t& base_price,
+                                    const uint64_t& slope);
+
+    /**
+     * Remove the bonding curve of an accepted token,it is sold at `rate` again.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param token - Acceptable asset contract.
+     */
+    [[eosio::action]] void rmcurve(const name& caller, const name& token);
+
+    /**
+     * Claim the org tokens bought through the ledger.
+     * When org_contract has deposited enough org token(transfer with memo `deposit`),
+     * an exchange only credits the ledger and sends no inline action.
+     *
+     * @param account - The buyer.
+     */
+    [[eosio::action]] void claim(const name& account);
+
+    /**
+     * Forward receivable accepted tokens to org_contract,at most `max_rows` tokens per call.Anyone can call it.
+     *
+     * @param max_rows - The maximum number of tokens to be forwarded in this call.
+     */
+    [[eosio::action]] void sweep(const uint64_t& max_rows);
+
+    /**
+     * Withdraw org token inventory back to org_contract.
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param quantity - The quantity to be withdrawn.
+     */
+    [[eosio::action]] void withdrawinv(const name& caller, const asset& quantity);
+
+    /**
+     * Cancel an order of the order book and refund the rest of it.
+     * Orders are placed by transferring with memo:
+     * `ask:price,quote:quote_contract` - sell org token.
+     * `bid:price` - buy org token with an accepted token.
+     *
+     * @param owner - The order owner.
+     * @param quote - Quote token contract(the `exchangein` token).
+     * @param is_bid - Whether it is a bid.
+     * @param id - Order id.
+     */
+    [[eosio::action]] void cancelorder(const name& owner, const name& quote, const bool& is_bid, const uint64_t& id);
+
+    /**
+     * Restrict `exchange` and bids to an allowlist,a zero root removes it.
+     * A resting bid reserves the allocation it can buy,the unfilled part is released when it is cancelled or refunded.
+     * Leaves are sha256(pack(account, max_allocation)),sorted pair hashing(lib/merkle.hpp).
+     *
+     * @param caller - Account who send the transaction.Used as permission check.
+     * @param root - The merkle root.
+     */
+    [[eosio::action]] void setallowlist(const name& caller, const checksum256& root);
+
+    /**
+     * Prove an allowlist leaf before exchanging.The proof does not fit a transfer memo,
+     * so it is checked once here and the allocation is tracked afterwards.
+     *
+     * @param account - The buyer.
+     * @param max_allocation - Raw amount of org token the buyer may get.
+     * @param proof - The merkle proof of the leaf.
+     */
+    [[eosio::action]] void prove(const name& account, const uint64_t& max_allocation, const vector<checksum256>& proof);
+
     void mtransfer(const name& contract, const structs::trx_tb& tx);
 
 private:
-    void _check(const name& act, const name& caller);
-
-    dsconf _get_config();
+    converter::engine<converter::approvetrx_payout> conv;
 
-    void _save_conf(const name& token,
-                    const bool& limit,
-                    const asset& max_quantity,
-                    const name& org_contract,
-                    const bool& is_init);
+    uint64_t _curve_out(const curves& c, const uint64_t& sold, const uint64_t& quote_amount);
+    void _place_bid(const name& contract, const structs::trx_tb& tx, const uint64_t& price);
+    void _place_ask(const dsconf& conf, const name& quote, const structs::trx_tb& tx, const uint64_t& price);
+    symbol _get_quote_symbol(const name& quote);
+    uint64_t _memo_u64(const memo::fields& f, const string_view& key);
+    name _memo_name(const memo::fields& f, const string_view& key);
+    void _add_ledger(const name& owner, const name& token, const asset& quantity);
+    bool _sub_ledger(const name& owner, const name& token, const asset& quantity);
+    bool _use_allocation(const name& account, const asset& out);
+    void _release_allocation(const name& account, const uint64_t& amount);
+    void _transfer_action(const name& contract, const name& to, const asset& quantity, const string& memo);
 };
 
 extern "C" {
@@ -134,7 +270,7 @@ void apply(uint64_t receiver, uint64_t code, uint64_t action) {
         return;
 
     switch (action) {
-        EOSIO_DISPATCH_HELPER(tokenmarket, (init)(changeconf)(addexin)(rmexin))
+        EOSIO_DISPATCH_HELPER(tokenmarket, (init)(changeconf)(addexin)(rmexin)(setcurve)(rmcurve)(claim)(sweep)(withdrawinv)(cancelorder)(setallowlist)(prove))
     }
     eosio_exit(0);
 }
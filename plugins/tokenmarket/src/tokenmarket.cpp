@@ -7,19 +7,8 @@ ACTION tokenmarket::init(const name& token,
                        const name& org_contract) {
     require_auth(get_self());
 
-    _save_conf(token, limit, max_quantity, org_contract, true);
-
-    exin_idx et(get_self(), get_self().value);
-    check(et.begin() == et.end(), CODE_10006);
-    check(ins.size() > 0, CODE_10001);
-
-    const uint64_t precision_scale = pow(10, safemath::sub(12, max_quantity.symbol.precision()));
-    for (auto const& r : ins) {
-        check(r.rate >= precision_scale, CODE_10002);
-        et.emplace(get_self(), [&](auto& m) {
-            m = r;
-        });
-    }
+    conv.save_conf(token, limit, max_quantity, org_contract, true);
+    conv.init_exins(ins, max_quantity.symbol);
     require_recipient(LOG_REC);
 }
 
@@ -28,9 +17,9 @@ ACTION tokenmarket::changeconf(const name& caller,
                              const bool& limit,
                              const asset& max_quantity) {
     require_auth(caller);
-    _check(VA_CHANGE_CONF, caller);
+    conv.check_perm(VA_CHANGE_CONF, caller);
 
-    _save_conf(token, limit, max_quantity, name { "" }, false);
+    conv.save_conf(token, limit, max_quantity, name { "" }, false);
 }
 
 ACTION tokenmarket::addexin(const name& caller,
@@ -38,116 +27,468 @@ ACTION tokenmarket::addexin(const name& caller,
                           const symbol_code& symbol_code,
                           const uint64_t rate) {
     require_auth(caller);
-    _check(VA_ADD_EXIN, caller);
+    conv.check_perm(VA_ADD_EXIN, caller);
 
-    exin_idx et(get_self(), get_self().value);
-    check(et.find(token.value) == et.end(), CODE_10003);
-
-    dsconf_idx dt(get_self(), get_self().value);
+    conv.add_exin(token, symbol_code, rate);
+}
 
-    const uint64_t precision_scale = pow(10, safemath::sub(12, dt.get().max_quantity.symbol.precision()));
-    check(rate >= precision_scale, CODE_10002);
+ACTION tokenmarket::rmexin(const name& caller, const name& token) {
+    require_auth(caller);
+    conv.check_perm(VA_ADD_EXIN, caller);
 
-    et.emplace(get_self(), [&](auto& m) {
-        m.token = token;
-        m.symbol_code = symbol_code;
-        m.rate = rate;
-    });
+    conv.rm_exin(token);
 }
 
-ACTION tokenmarket::rmexin(const name& caller, const name& token) {
+ACTION tokenmarket::setcurve(const name& caller,
+                             const name& token,
+                             const uint64_t& base_price,
+                             const uint64_t& slope) {
     require_auth(caller);
-    _check(VA_ADD_EXIN, caller);
+    conv.check_perm(VA_SET_CURVE, caller);
+    check(conv.get_config().limit, CODE_10013);
+    check(base_price > 0, CODE_10015);
 
     exin_idx et(get_self(), get_self().value);
-    auto itr = et.find(token.value);
-    check(itr != et.end(), CODE_10004);
-    et.erase(itr);
+    check(et.find(token.value) != et.end(), CODE_10004);
+
+    curve_idx ct(get_self(), get_self().value);
+    auto itr = ct.find(token.value);
+    if (itr == ct.end()) {
+        ct.emplace(get_self(), [&](auto& m) {
+            m.token = token;
+            m.base_price = base_price;
+            m.slope = slope;
+        });
+    } else {
+        ct.modify(itr, same_payer, [&](auto& m) {
+            m.base_price = base_price;
+            m.slope = slope;
+        });
+    }
+}
+
+ACTION tokenmarket::rmcurve(const name& caller, const name& token) {
+    require_auth(caller);
+    conv.check_perm(VA_SET_CURVE, caller);
+
+    curve_idx ct(get_self(), get_self().value);
+    auto itr = ct.find(token.value);
+    check(itr != ct.end(), CODE_10014);
+    ct.erase(itr);
 }
 
 ACTION tokenmarket::mtransfer(const name& contract, const structs::trx_tb& tx) {
     if (tx.from == get_self() || tx.to != get_self())
         return;
 
+    const memo::fields f(tx.memo);
+    string_view order;
+
+    //format: bid:price
+    if (f.get("bid", order)) {
+        _place_bid(contract, tx, _memo_u64(f, "bid"));
+        return;
+    }
+
+    //format: ask:price,quote:quote_contract
+    if (f.get("ask", order)) {
+        const auto& conf = conv.get_config();
+        check(contract == conf.token && tx.quantity.symbol == conf.max_quantity.symbol, CODE_10012);
+        _place_ask(conf, _memo_name(f, "quote"), tx, _memo_u64(f, "ask"));
+        return;
+    }
+
+    if ("deposit" == tx.memo) {
+        const auto& conf = conv.get_config();
+        check(tx.from == conf.org_contract, CODE_10011);
+        check(contract == conf.token && tx.quantity.symbol == conf.max_quantity.symbol, CODE_10012);
+        _add_ledger(get_self(), contract, tx.quantity);
+        return;
+    }
+
     if ("exchange" != tx.memo)
         return;
 
-    exin_idx rt(get_self(), get_self().value);
-    auto itr = rt.find(contract.value);
-    if (itr == rt.end())
+    exchange_in in;
+    if (!conv.find_exin(contract, tx.quantity, in))
         return;
 
-    if (tx.quantity.symbol.code() != itr->symbol_code)
+    const auto& conf = conv.get_config();
+
+    asset out;
+    curve_idx ct(get_self(), get_self().value);
+    auto citr = ct.find(contract.value);
+    if (citr != ct.end()) {
+        const uint64_t sold = conf.max_quantity.amount - conv.get_counter().remaining_quantity.amount;
+        out = asset(_curve_out(*citr, sold, tx.quantity.amount), conf.max_quantity.symbol);
+    } else {
+        out = asset(conv.rate_out(tx.quantity.amount, in.rate), conf.max_quantity.symbol);
+    }
+
+    check(out.amount > 0, CODE_10012);
+    _use_allocation(tx.from, out);
+    conv.reserve(conf, out);
+
+    // paid from the inventory,settled later by `claim` and `sweep`
+    if (_sub_ledger(get_self(), conf.token, out)) {
+        _add_ledger(tx.from, conf.token, out);
+        _add_ledger(conf.org_contract, contract, tx.quantity);
         return;
+    }
 
-    dsconf_idx dt(get_self(), get_self().value);
-    auto conf = dt.get();
+    conv.forward(conf, contract, tx.quantity, tx.memo);
+    conv.payout(conf, tx.from, out, tx.memo);
+}
 
-    double r = (double)itr->rate / (double)BASE_SCALE;
-    asset out = asset((double)tx.quantity.amount * r, conf.max_quantity.symbol);
+ACTION tokenmarket::claim(const name& account) {
+    require_auth(account);
 
-    if (conf.limit) {
-        check(conf.remaining_quantity.amount >= out.amount, CODE_10007);
-        conf.remaining_quantity -= out;
-        dt.set(conf, get_self());
+    ledger_idx lt(get_self(), account.value);
+    auto itr = lt.begin();
+    check(itr != lt.end(), CODE_10016);
+    while (itr != lt.end()) {
+        _transfer_action(itr->token, account, itr->balance, "claim");
+        itr = lt.erase(itr);
     }
+}
 
-    // IN
-    action(permission_level { get_self(), name("active") },
-           contract, name("transfer"),
-           std::make_tuple(get_self(), conf.org_contract, tx.quantity, tx.memo))
-        .send();
+ACTION tokenmarket::sweep(const uint64_t& max_rows) {
+    check(max_rows > 0, CODE_10017);
+    const auto& conf = conv.get_config();
 
-    // OUT
-    action(permission_level { get_self(), name("active") },
-           conf.org_contract, name("approvetrx"),
-           std::make_tuple(get_self(), conf.token, tx.from, out, tx.memo))
-        .send();
+    ledger_idx lt(get_self(), conf.org_contract.value);
+    auto itr = lt.begin();
+    uint64_t swept = 0;
+    while (itr != lt.end() && swept < max_rows) {
+        _transfer_action(itr->token, conf.org_contract, itr->balance, "sweep");
+        itr = lt.erase(itr);
+        swept++;
+    }
+}
+
+ACTION tokenmarket::withdrawinv(const name& caller, const asset& quantity) {
+    require_auth(caller);
+    conv.check_perm(VA_WITHDRAW_INV, caller);
+
+    const auto& conf = conv.get_config();
+    check(_sub_ledger(get_self(), conf.token, quantity), CODE_10007);
+    _transfer_action(conf.token, conf.org_contract, quantity, "withdraw inventory");
+}
+
+ACTION tokenmarket::cancelorder(const name& owner, const name& quote, const bool& is_bid, const uint64_t& id) {
+    require_auth(owner);
+
+    if (is_bid) {
+        bids_idx bt(get_self(), quote.value);
+        auto itr = bt.find(id);
+        check(itr != bt.end() && itr->owner == owner, CODE_10010);
+        _release_allocation(owner, itr->allocated);
+        _transfer_action(itr->escrow_token, owner, itr->quantity, "cancel order");
+        bt.erase(itr);
+    } else {
+        asks_idx at(get_self(), quote.value);
+        auto itr = at.find(id);
+        check(itr != at.end() && itr->owner == owner, CODE_10010);
+        _transfer_action(itr->escrow_token, owner, itr->quantity, "cancel order");
+        at.erase(itr);
+    }
+}
+
+ACTION tokenmarket::setallowlist(const name& caller, const checksum256& root) {
+    require_auth(caller);
+    conv.check_perm(VA_SET_ALLOWLIST, caller);
+
+    allowlist_idx at(get_self(), get_self().value);
+    if (root == checksum256()) {
+        at.remove();
+        return;
+    }
+    at.set(allowlist { .root = root }, get_self());
+}
+
+ACTION tokenmarket::prove(const name& account, const uint64_t& max_allocation, const vector<checksum256>& proof) {
+    require_auth(account);
+
+    allowlist_idx at(get_self(), get_self().value);
+    check(at.exists(), CODE_10019);
+    const checksum256 root = at.get().root;
+
+    const auto leaf = merkle::leaf(std::make_tuple(account, max_allocation));
+    check(merkle::verify(root, leaf, proof), CODE_10018);
+
+    allocation_idx lt(get_self(), get_self().value);
+    auto itr = lt.find(account.value);
+    if (itr == lt.end()) {
+        lt.emplace(account, [&](auto& m) {
+            m.account = account;
+            m.root = root;
+            m.max_allocation = max_allocation;
+            m.used = 0;
+        });
+    } else {
+        // a new list keeps what has been bought
+        lt.modify(itr, same_payer, [&](auto& m) {
+            m.root = root;
+            m.max_allocation = max_allocation;
+        });
+    }
 }
 
-void tokenmarket::_check(const name& act, const name& caller) {
-    auto auth = auths();
-    auth.check_perm(_get_config().org_contract, get_self(), act, caller);
+// false when there is no allowlist
+bool tokenmarket::_use_allocation(const name& account, const asset& out) {
+    allowlist_idx at(get_self(), get_self().value);
+    if (!at.exists())
+        return false;
+
+    allocation_idx lt(get_self(), get_self().value);
+    auto itr = lt.find(account.value);
+    check(itr != lt.end() && itr->root == at.get().root, CODE_10019);
+
+    const uint64_t used = safemath::add(itr->used, out.amount);
+    check(used <= itr->max_allocation, CODE_10020);
+    lt.modify(itr, same_payer, [&](auto& m) {
+        m.used = used;
+    });
+    return true;
 }
 
-tokenmarket::dsconf tokenmarket::_get_config() {
-    dsconf_idx ct(get_self(), get_self().value);
-    return ct.get();
+void tokenmarket::_release_allocation(const name& account, const uint64_t& amount) {
+    if (amount == 0)
+        return;
+
+    allocation_idx lt(get_self(), get_self().value);
+    auto itr = lt.find(account.value);
+    if (itr == lt.end())
+        return;
+
+    lt.modify(itr, same_payer, [&](auto& m) {
+        m.used -= std::min(m.used, amount);
+    });
 }
 
-void tokenmarket::_save_conf(const name& token,
-                           const bool& limit,
-                           const asset& max_quantity,
-                           const name& org_contract,
-                           const bool& is_init) {
-    dsconf_idx dt(get_self(), get_self().value);
+uint64_t tokenmarket::_curve_out(const curves& c, const uint64_t& sold, const uint64_t& quote_amount) {
+    // cost of x from `sold`: (base_price * x + slope * (sold * x + x^2 / 2)) / BASE_SCALE = quote_amount
+    // x = (sqrt(b^2 + 2 * slope * q) - b) / slope, b = base_price + slope * sold, q = quote_amount * BASE_SCALE
+    const uint128_t b = safemath::add128(c.base_price, safemath::mul128(c.slope, sold));
+    const uint128_t q = safemath::mul128(quote_amount, BASE_SCALE);
 
-    if (is_init)
-        check(!dt.exists(), CODE_10006);
-    else
-        check(dt.exists(), CODE_10005);
+    uint128_t x;
+    if (c.slope == 0) {
+        x = q / b;
+    } else {
+        const uint128_t d = safemath::add128(safemath::mul128(b, b), safemath::mul128(2 * (uint128_t)c.slope, q));
+        x = (safemath::sqrt128(d) - b) / c.slope;
+    }
+    check(x <= asset::max_amount, "math mul overflow");
+    return x;
+}
 
-    auto a = assets();
-    auto stat = a.get_stats(token, max_quantity.symbol);
-    check(stat.supply.symbol == max_quantity.symbol, CODE_10000);
+void tokenmarket::_place_bid(const name& contract, const structs::trx_tb& tx, const uint64_t& price) {
+    exin_idx rt(get_self(), get_self().value);
+    auto eitr = rt.find(contract.value);
+    check(eitr != rt.end() && tx.quantity.symbol.code() == eitr->symbol_code, CODE_10011);
+    check(price > 0, CODE_10009);
 
-    if (limit) {
-        check(max_quantity.amount > 0, CODE_10000);
+    const auto& conf = conv.get_config();
+    const symbol base_sym = conf.max_quantity.symbol;
+    const uint128_t scale = pow(10, base_sym.precision());
+
+    asks_idx at(get_self(), contract.value);
+    auto idx = at.get_index<name("byprice")>();
+    auto itr = idx.begin();
+
+    int64_t quote_left = tx.quantity.amount;
+    int64_t base_bought = 0;
+    uint64_t fills = 0;
+    // match the lowest asks at their price
+    while (itr != idx.end() && itr->price <= price && fills < MAX_FILLS) {
+        // an ask placed before a changeconf is priced and delivered in its own escrow token
+        const uint128_t ask_scale = pow(10, itr->quantity.symbol.precision());
+
+        // clamped to the ask in 128 bits,so a low price can not wrap the result
+        const uint128_t affordable = (uint128_t)quote_left * ask_scale / itr->price;
+        const int64_t base = std::min(affordable, (uint128_t)itr->quantity.amount);
+        if (base == 0)
+            break;
+
+        // round up in favor of the ask,never above quote_left
+        const int64_t cost = ((uint128_t)base * itr->price + ask_scale - 1) / ask_scale;
+        quote_left -= cost;
+        fills++;
+
+        _transfer_action(contract, itr->owner, asset(cost, tx.quantity.symbol), "ask filled");
+        if (itr->escrow_token == conf.token && itr->quantity.symbol == base_sym)
+            base_bought += base;
+        else
+            _transfer_action(itr->escrow_token, tx.from, asset(base, itr->quantity.symbol), "bid filled");
+        if (base == itr->quantity.amount) {
+            itr = idx.erase(itr);
+        } else {
+            idx.modify(itr, same_payer, [&](auto& m) {
+                m.quantity.amount -= base;
+            });
+            itr++;
+        }
+    }
+
+    if (base_bought > 0) {
+        // org token bought from the book counts against the allowlist allocation as well
+        _use_allocation(tx.from, asset(base_bought, base_sym));
+        _transfer_action(conf.token, tx.from, asset(base_bought, base_sym), "bid filled");
+    }
+
+    // the rest is refunded when the book still crosses or it can not buy anything
+    const bool crossing = itr != idx.end() && itr->price <= price;
+    if (quote_left > 0 && (crossing || (uint128_t)quote_left * scale / price == 0)) {
+        _transfer_action(contract, tx.from, asset(quote_left, tx.quantity.symbol), "refund");
+    } else if (quote_left > 0) {
+        // what the bid can buy has to fit an asset
+        const uint128_t capacity = (uint128_t)quote_left * scale / price;
+        check(capacity <= asset::max_amount, CODE_10012);
+
+        // reserved now,so a fill by a later ask never has to check the allowlist
+        const uint64_t allocated = _use_allocation(tx.from, asset(capacity, base_sym)) ? (uint64_t)capacity : 0;
+
+        bids_idx bt(get_self(), contract.value);
+        bt.emplace(get_self(), [&](auto& m) {
+            m.id = bt.available_primary_key();
+            m.owner = tx.from;
+            m.is_bid = true;
+            m.price = price;
+            m.quantity = asset(quote_left, tx.quantity.symbol);
+            m.created_at = current_time_point().sec_since_epoch();
+            m.escrow_token = contract;
+            m.allocated = allocated;
+        });
     }
+}
+
+void tokenmarket::_place_ask(const dsconf& conf, const name& quote, const structs::trx_tb& tx, const uint64_t& price) {
+    check(price > 0, CODE_10009);
+
+    const symbol quote_sym = _get_quote_symbol(quote);
+    const uint128_t scale = pow(10, tx.quantity.symbol.precision());
+
+    bids_idx bt(get_self(), quote.value);
+    auto idx = bt.get_index<name("byprice")>();
+    auto itr = idx.begin();
 
-    dsconf conf_slt;
-    if (!is_init) {
-        conf_slt = dt.get();
-        conf_slt.token = token;
-        conf_slt.limit = limit;
-        conf_slt.max_quantity = max_quantity;
+    int64_t base_left = tx.quantity.amount;
+    int64_t quote_earned = 0;
+    uint64_t fills = 0;
+    // match the highest bids at their price
+    while (itr != idx.end() && itr->price >= price && fills < MAX_FILLS && base_left > 0) {
+        // clamped to base_left in 128 bits,so a low bid price can not wrap the result
+        const uint128_t capacity = (uint128_t)itr->quantity.amount * scale / itr->price;
+        const int64_t base = std::min(capacity, (uint128_t)base_left);
+
+        // round down in favor of the bid,never above its escrow
+        const int64_t cost = (uint128_t)base * itr->price / scale;
+        base_left -= base;
+        quote_earned += cost;
+        fills++;
+
+        if (base > 0)
+            _transfer_action(conf.token, itr->owner, asset(base, tx.quantity.symbol), "bid filled");
+
+        const int64_t rest = itr->quantity.amount - cost;
+        const uint64_t allocated = itr->allocated - std::min(itr->allocated, (uint64_t)base);
+        if (rest == 0 || (uint128_t)rest * scale / itr->price == 0) {
+            // refund dust that can not buy anything
+            if (rest > 0)
+                _transfer_action(itr->escrow_token, itr->owner, asset(rest, itr->quantity.symbol), "refund");
+            _release_allocation(itr->owner, allocated);
+            itr = idx.erase(itr);
+        } else {
+            idx.modify(itr, same_payer, [&](auto& m) {
+                m.quantity.amount = rest;
+                m.allocated = allocated;
+            });
+            itr++;
+        }
+    }
+
+    if (quote_earned > 0)
+        _transfer_action(quote, tx.from, asset(quote_earned, quote_sym), "ask filled");
+
+    const bool crossing = itr != idx.end() && itr->price >= price;
+    if (base_left > 0 && crossing) {
+        _transfer_action(conf.token, tx.from, asset(base_left, tx.quantity.symbol), "refund");
+    } else if (base_left > 0) {
+        // what the ask earns has to fit an asset
+        check((uint128_t)base_left * price / scale <= asset::max_amount, CODE_10012);
+
+        asks_idx at(get_self(), quote.value);
+        at.emplace(get_self(), [&](auto& m) {
+            m.id = at.available_primary_key();
+            m.owner = tx.from;
+            m.is_bid = false;
+            m.price = price;
+            m.quantity = asset(base_left, tx.quantity.symbol);
+            m.created_at = current_time_point().sec_since_epoch();
+            m.escrow_token = conf.token;
+            m.allocated = 0;
+        });
+    }
+}
+
+symbol tokenmarket::_get_quote_symbol(const name& quote) {
+    exin_idx rt(get_self(), get_self().value);
+    auto eitr = rt.find(quote.value);
+    check(eitr != rt.end(), CODE_10011);
+
+    assets::stats_idx st(quote, eitr->symbol_code.raw());
+    auto sitr = st.find(eitr->symbol_code.raw());
+    check(sitr != st.end(), CODE_10011);
+    return sitr->supply.symbol;
+}
+
+uint64_t tokenmarket::_memo_u64(const memo::fields& f, const string_view& key) {
+    uint64_t value;
+    check(f.get_u64(key, value), CODE_10008);
+    return value;
+}
+
+name tokenmarket::_memo_name(const memo::fields& f, const string_view& key) {
+    name value;
+    check(f.get_name(key, value), CODE_10008);
+    return value;
+}
+
+void tokenmarket::_add_ledger(const name& owner, const name& token, const asset& quantity) {
+    ledger_idx lt(get_self(), owner.value);
+    auto itr = lt.find(token.value);
+    if (itr == lt.end()) {
+        lt.emplace(get_self(), [&](auto& m) {
+            m.token = token;
+            m.balance = quantity;
+        });
+    } else {
+        lt.modify(itr, same_payer, [&](auto& m) {
+            m.balance += quantity;
+        });
+    }
+}
+
+bool tokenmarket::_sub_ledger(const name& owner, const name& token, const asset& quantity) {
+    ledger_idx lt(get_self(), owner.value);
+    auto itr = lt.find(token.value);
+    if (itr == lt.end() || itr->balance.symbol != quantity.symbol || itr->balance < quantity)
+        return false;
+
+    if (itr->balance == quantity) {
+        lt.erase(itr);
     } else {
-        conf_slt.token = token;
-        conf_slt.limit = limit;
-        conf_slt.max_quantity = max_quantity;
-        conf_slt.remaining_quantity = limit ? max_quantity : asset(0, max_quantity.symbol);
-        conf_slt.org_contract = org_contract;
+        lt.modify(itr, same_payer, [&](auto& m) {
+            m.balance -= quantity;
+        });
     }
+    return true;
+}
 
-    dt.set(conf_slt, get_self());
-}
\ No newline at end of file
+void tokenmarket::_transfer_action(const name& contract, const name& to, const asset& quantity, const string& memo) {
+    action(permission_level { get_self(), name("active") },
+           contract, name("transfer"),
+           std::make_tuple(get_self(), to, quantity, memo))
+        .send();
+}
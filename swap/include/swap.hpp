@@ -1,4 +1,6 @@
 #pragma once
+#include "../../lib/consts.hpp"
+#include "../../lib/memo.hpp"
 #include "../../lib/safemath.hpp"
 #include "../../lib/structs.hpp"
 #include <eosio/asset.hpp>
@@ -22,6 +24,97 @@ public:
 
     [[eosio::action]] void vote(const name& token_contract, const name& voter);
 
+    /**
+     * Transfer liquidity(the `mint` balance) of a pair.
+     * Both accounts are notified,e.g. a mining contract can take it as a stake.
+     *
+     * @param from - The account to transfer from.
+     * @param to - The account to be transferred to.
+     * @param token_contract - The pair token contract.
+     * @param amount - The liquidity amount.
+     * @param memo - The memo string to accompany the transaction.
+     */
+    [[eosio::action]] void transferlp(const name& from,
+                                      const name& to,
+                                      const name& token_contract,
+                                      const uint64_t& amount,
+                                      const string& memo);
+
+    /**
+     * Swap with the deposited balances,no token transfer is involved.
+     * Deposit by transferring EOS or a pair token with memo `action:deposit`.
+     *
+     * @param user - The trader.
+     * @param pair - The pair token contract.
+     * @param amount_in - EOS to buy the token,or the token to sell for EOS.
+     * @param min_out - Minimum output amount.
+     */
+    [[eosio::action]] void swap(const name& user, const name& pair, const asset& amount_in, const uint64_t& min_out);
+
+    /**
+     * Swap a deposited balance along a path of token contracts,e.g. [eosio.token, tokenb] for tokena->EOS->tokenb.
+     * A hop uses the direct TOKEN/TOKEN pair when there is one,so [tokenb] is a single hop then.
+     * The same route is available to transfers with memo `action:route,path:c1-c2...,min_out:x,deadline:t`.
+     *
+     * @param user - The trader.
+     * @param contract - The input token contract.
+     * @param amount_in - The input quantity.
+     * @param path - Token contracts after the input one,the last is the output.
+     * @param min_out - Minimum output amount.
+     */
+    [[eosio::action]] void swaproute(const name& user,
+                                     const name& contract,
+                                     const asset& amount_in,
+                                     const vector<name>& path,
+                                     const uint64_t& min_out);
+
+    /**
+     * Add liquidity to a TOKEN/TOKEN pair from deposited balances,the pair is created when it does not exist.
+     * Each side is a registered token,EOS pools are the TOKEN/EOS pairs.The amounts are the maximum taken at the pair ratio.
+     *
+     * @param user - The liquidity provider.
+     * @param amount_a - One side.
+     * @param amount_b - The other side.
+     * @param min_liquidity - Minimum liquidity minted.
+     */
+    [[eosio::action]] void addliquidity(const name& user,
+                                        const extended_asset& amount_a,
+                                        const extended_asset& amount_b,
+                                        const uint64_t& min_liquidity);
+
+    /**
+     * Remove liquidity of a TOKEN/TOKEN pair,both sides are credited to the deposited balances.
+     *
+     * @param user - The liquidity provider.
+     * @param pair_id - The pair id.
+     * @param liquidity - The liquidity amount.
+     * @param min_amount0 - Minimum amount of reserve0.
+     * @param min_amount1 - Minimum amount of reserve1.
+     */
+    [[eosio::action]] void rmliquidity(const name& user,
+                                       const uint64_t& pair_id,
+                                       const uint64_t& liquidity,
+                                       const uint64_t& min_amount0,
+                                       const uint64_t& min_amount1);
+
+    /**
+     * Withdraw a deposited balance.
+     *
+     * @param user - The depositor.
+     * @param contract - The token contract.
+     * @param quantity - The quantity to withdraw.
+     */
+    [[eosio::action]] void withdraw(const name& user, const name& contract, const asset& quantity);
+
+    /**
+     * Erase the trade volumes of an epoch whose claim window(TRADE_CLAIM_EPOCHS) has passed,
+     * at most `max_rows` per call.Anyone can call it.
+     *
+     * @param epoch - The epoch.
+     * @param max_rows - The maximum number of volume rows to be erased in this call.
+     */
+    [[eosio::action]] void prunevol(const uint64_t& epoch, const uint64_t& max_rows);
+
     /**
      * Receive all transfers of this contract
      */
@@ -71,6 +164,44 @@ public:
         uint64_t primary_key() const { return voter.value; }
     };
 
+    // scope is self
+    // TOKEN/TOKEN pair,sides are ordered by (contract, symbol)
+    TABLE pairs {
+        uint64_t id;
+        extended_asset reserve0;
+        extended_asset reserve1;
+        uint64_t total_supply;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t by_contracts() const { return contracts_key(reserve0.contract, reserve1.contract); }
+    };
+
+    // scope is account
+    // internal balances for `swap`,keyed by token contract
+    TABLE deposits {
+        name contract;
+        asset balance;
+
+        uint64_t primary_key() const { return contract.value; }
+    };
+
+    // scope is epoch
+    // EOS side volume(raw) of the swaps of an account,read by mining for trade mining
+    TABLE trade_volumes {
+        name account;
+        uint64_t volume;
+
+        uint64_t primary_key() const { return account.value; }
+    };
+
+    // scope is self
+    TABLE epoch_volumes {
+        uint64_t epoch;
+        uint64_t volume;
+
+        uint64_t primary_key() const { return epoch; }
+    };
+
     struct currency_stats {
         asset supply;
         asset max_supply;
@@ -84,36 +215,62 @@ public:
     using mint_idx = multi_index<"mint"_n, mints>;
     using allow_idx = multi_index<"allow"_n, allows>;
     using vote_idx = multi_index<"vote"_n, votes>;
+    using deposit_idx = multi_index<"deposit"_n, deposits>;
+    using pair_idx = multi_index<"pair"_n, pairs,
+                                 indexed_by<"bycontracts"_n, const_mem_fun<pairs, uint128_t, &pairs::by_contracts>>>;
+    // scope is pair id
+    using pairmint_idx = multi_index<"pairmint"_n, mints>;
+
+    // both orders give the same key,symbols are compared on the rows
+    static uint128_t contracts_key(const name& a, const name& b) {
+        return a.value < b.value ? (uint128_t)a.value << 64 | b.value : (uint128_t)b.value << 64 | a.value;
+    }
+    using tradevol_idx = multi_index<"tradevol"_n, trade_volumes>;
+    using epochvol_idx = multi_index<"epochvol"_n, epoch_volumes>;
     using stats_idx = multi_index<"stat"_n, currency_stats>;
 
 private:
-    void _create_pair(const structs::trx_tb& tx, vector<string> vec);
-    void _add_liquidity(const structs::trx_tb& tx, vector<string> vec);
-    void _remove_liquidity(const name& contract, const structs::trx_tb& tx, vector<string> vec);
+    void _create_pair(const structs::trx_tb& tx, const memo::fields& f);
+    void _add_liquidity(const structs::trx_tb& tx, const memo::fields& f);
+    void _remove_liquidity(const name& contract, const structs::trx_tb& tx, const memo::fields& f);
 
-    void _eos_to_token(const structs::trx_tb& tx, vector<string> vec);
-    void _token_to_eos(const name& contract, const structs::trx_tb& tx, vector<string> vec);
-    void _token_to_token(const name& contract, const structs::trx_tb& tx, vector<string> vec);
+    void _eos_to_token(const structs::trx_tb& tx, const memo::fields& f);
+    asset _buy_token(const name& token_contract, const asset& eos_quantity, const uint64_t& min_tokens);
+    asset _sell_token(const name& token_contract, const asset& tokens_sold, const uint64_t& min_eos);
+    void _token_to_eos(const name& contract, const structs::trx_tb& tx, const memo::fields& f);
+    void _token_to_token(const name& contract, const structs::trx_tb& tx, const memo::fields& f);
+    void _route_memo(const name& contract, const structs::trx_tb& tx, const memo::fields& f);
+    asset _hop(const name& contract, const asset& amount, const name& next);
+    bool _swap_pair(const name& contract, const asset& amount_in, const name& out_contract, asset& out);
+    void _check_pair_token(const extended_asset& quantity);
+    void _add_pair_mint(const uint64_t& pair_id, const name& account, const uint64_t& amount);
+    asset _route(const name& trader, const name& contract, const asset& amount_in, const vector<name>& path, const uint64_t& min_out);
 
     void _approve(const name& contract, const structs::trx_tb& tx);
-    void _cancel_approve(const name& contract, const structs::trx_tb& tx, vector<string> vec);
+    void _cancel_approve(const name& contract, const structs::trx_tb& tx, const memo::fields& f);
 
-    void _apply_add_token(const structs::trx_tb& tx, vector<string> vec);
+    void _apply_add_token(const structs::trx_tb& tx, const memo::fields& f);
+
+    void _deposit(const name& contract, const structs::trx_tb& tx);
+    void _add_deposit(const name& owner, const name& contract, const asset& quantity);
+    void _sub_deposit(const name& owner, const name& contract, const asset& quantity);
 
     void _check_eos(const name& contract, const asset& quantity);
     void _check_asset_eos(const asset& quantity);
     void _check_asset(const asset& quantity, const symbol& symbol);
 
-    void _split_memo(vector<string> & results, string memo, char separator);
-    string _split_val(const vector<string>& kv_vec, string k);
-    string _split_val(const vector<string>& kv_vec, string k, bool kv);
+    uint64_t _memo_u64(const memo::fields& f, const string_view& key);
+    name _memo_name(const memo::fields& f, const string_view& key);
 
     dsswap::tokens _get_token(const name& contract);
+    void _add_volume(const name& account, const uint64_t& eos_amount);
     uint64_t _get_input_price(const uint64_t& input_amount, const uint64_t& input_reserve, const uint64_t& output_reserve);
 
     void _transfer_action(const name& contract, const name& to, const asset& quantity, const string& memo);
     void _transfer_from(const name& from, const name& contract, const asset& quantity);
 
+    static constexpr size_t MAX_ROUTE_HOPS = 6;
+
     const name EOS_CONTRACT = name("eosio.token");
     const symbol EOS_SYMBOL = symbol(symbol_code("EOS"), 4);
 };
@@ -131,7 +288,7 @@ void apply(uint64_t receiver, uint64_t code, uint64_t action) {
         return;
 
     switch (action) {
-        EOSIO_DISPATCH_HELPER(dsswap, (vote))
+        EOSIO_DISPATCH_HELPER(dsswap, (vote)(transferlp)(swap)(swaproute)(addliquidity)(rmliquidity)(withdraw)(prunevol))
     }
     eosio_exit(0);
 }
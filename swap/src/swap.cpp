@@ -39,45 +39,258 @@ ACTION dsswap::vote(const name& token_contract, const name& voter) {
     }
 }
 
+ACTION dsswap::transferlp(const name& from,
+                          const name& to,
+                          const name& token_contract,
+                          const uint64_t& amount,
+                          const string& memo) {
+    require_auth(from);
+    check(from != to, "cannot transfer to self");
+    check(is_account(to), "to account does not exist");
+    check(amount > 0, "invalid amount");
+    check(memo.size() <= 256, "memo has more than 256 bytes");
+    _get_token(token_contract);
+
+    mint_idx mt(get_self(), token_contract.value);
+    auto fitr = mt.find(from.value);
+    check(fitr != mt.end() && fitr->amount >= amount, "amount too high");
+    mt.modify(fitr, same_payer, [&](auto& m) {
+        m.amount -= amount;
+    });
+
+    auto titr = mt.find(to.value);
+    if (titr == mt.end()) {
+        mt.emplace(get_self(), [&](auto& m) {
+            m.account = to;
+            m.amount = amount;
+        });
+    } else {
+        mt.modify(titr, same_payer, [&](auto& m) {
+            m.amount = safemath::add(m.amount, amount);
+        });
+    }
+
+    require_recipient(from);
+    require_recipient(to);
+}
+
+ACTION dsswap::swap(const name& user, const name& pair, const asset& amount_in, const uint64_t& min_out) {
+    require_auth(user);
+    check(amount_in.is_valid() && amount_in.amount > 0, "invalid asset quantity");
+
+    if (amount_in.symbol == EOS_SYMBOL) {
+        _sub_deposit(user, EOS_CONTRACT, amount_in);
+        const asset tokens_bought = _buy_token(pair, amount_in, min_out);
+        _add_volume(user, amount_in.amount);
+        _add_deposit(user, pair, tokens_bought);
+    } else {
+        _sub_deposit(user, pair, amount_in);
+        const asset eos_bought = _sell_token(pair, amount_in, min_out);
+        _add_volume(user, eos_bought.amount);
+        _add_deposit(user, EOS_CONTRACT, eos_bought);
+    }
+}
+
+ACTION dsswap::swaproute(const name& user,
+                         const name& contract,
+                         const asset& amount_in,
+                         const vector<name>& path,
+                         const uint64_t& min_out) {
+    require_auth(user);
+    check(amount_in.is_valid() && amount_in.amount > 0, "invalid asset quantity");
+
+    _sub_deposit(user, contract, amount_in);
+    const asset out = _route(user, contract, amount_in, path, min_out);
+    _add_deposit(user, path.back(), out);
+}
+
+ACTION dsswap::addliquidity(const name& user,
+                            const extended_asset& amount_a,
+                            const extended_asset& amount_b,
+                            const uint64_t& min_liquidity) {
+    require_auth(user);
+    _check_pair_token(amount_a);
+    _check_pair_token(amount_b);
+
+    const bool a_first = amount_a.contract.value < amount_b.contract.value ||
+                         (amount_a.contract == amount_b.contract && amount_a.quantity.symbol.raw() < amount_b.quantity.symbol.raw());
+    const extended_asset& in0 = a_first ? amount_a : amount_b;
+    const extended_asset& in1 = a_first ? amount_b : amount_a;
+    check(in0.contract != in1.contract || in0.quantity.symbol != in1.quantity.symbol, "must be different tokens");
+
+    pair_idx pt(get_self(), get_self().value);
+    auto idx = pt.get_index<name("bycontracts")>();
+    auto itr = idx.lower_bound(contracts_key(in0.contract, in1.contract));
+    while (itr != idx.end() && itr->by_contracts() == contracts_key(in0.contract, in1.contract) &&
+           (itr->reserve0.quantity.symbol != in0.quantity.symbol || itr->reserve1.quantity.symbol != in1.quantity.symbol)) {
+        itr++;
+    }
+
+    uint64_t amount0 = in0.quantity.amount;
+    uint64_t amount1 = in1.quantity.amount;
+    uint64_t liquidity;
+    uint64_t pair_id;
+    if (itr == idx.end() || itr->by_contracts() != contracts_key(in0.contract, in1.contract)) {
+        liquidity = safemath::sqrt128(safemath::mul128(amount0, amount1));
+        check(liquidity >= min_liquidity && liquidity > 0, "did not meet expectations");
+
+        pair_id = pt.available_primary_key();
+        pt.emplace(get_self(), [&](auto& m) {
+            m.id = pair_id;
+            m.reserve0 = in0;
+            m.reserve1 = in1;
+            m.total_supply = liquidity;
+        });
+    } else {
+        const uint64_t reserve0 = itr->reserve0.quantity.amount;
+        const uint64_t reserve1 = itr->reserve1.quantity.amount;
+        check(reserve0 > 0 && reserve1 > 0, "invalid reserve");
+
+        // take the sides at the pair ratio,the rest stays deposited
+        // need1 is rounded up so that the ratio never moves against the pair
+        const uint128_t need1 = safemath::add128(safemath::mul128(amount0, reserve1), reserve0 - 1) / reserve0;
+        if (need1 <= amount1)
+            amount1 = need1;
+        else
+            amount0 = safemath::mul128(amount1, reserve0) / reserve1;
+
+        const uint128_t minted = safemath::mul128(amount0, itr->total_supply) / reserve0;
+        check(minted <= UINT64_MAX, "math mul overflow");
+        liquidity = minted;
+        check(amount0 > 0 && amount1 > 0, "invalid amount");
+        check(liquidity >= min_liquidity && liquidity > 0, "did not meet expectations");
+
+        pair_id = itr->id;
+        idx.modify(itr, same_payer, [&](auto& m) {
+            m.reserve0.quantity.amount = safemath::add(reserve0, amount0);
+            m.reserve1.quantity.amount = safemath::add(reserve1, amount1);
+            m.total_supply = safemath::add(m.total_supply, liquidity);
+        });
+    }
+
+    _sub_deposit(user, in0.contract, asset(amount0, in0.quantity.symbol));
+    _sub_deposit(user, in1.contract, asset(amount1, in1.quantity.symbol));
+    _add_pair_mint(pair_id, user, liquidity);
+}
+
+ACTION dsswap::rmliquidity(const name& user,
+                           const uint64_t& pair_id,
+                           const uint64_t& liquidity,
+                           const uint64_t& min_amount0,
+                           const uint64_t& min_amount1) {
+    require_auth(user);
+    check(liquidity > 0, "invalid amount");
+
+    pair_idx pt(get_self(), get_self().value);
+    auto itr = pt.find(pair_id);
+    check(itr != pt.end(), "pair does not exist");
+
+    pairmint_idx mt(get_self(), pair_id);
+    auto mitr = mt.find(user.value);
+    check(mitr != mt.end() && mitr->amount >= liquidity, "amount too high");
+    if (mitr->amount == liquidity) {
+        mt.erase(mitr);
+    } else {
+        mt.modify(mitr, same_payer, [&](auto& m) {
+            m.amount -= liquidity;
+        });
+    }
+
+    const uint64_t amount0 = safemath::mul128(itr->reserve0.quantity.amount, liquidity) / itr->total_supply;
+    const uint64_t amount1 = safemath::mul128(itr->reserve1.quantity.amount, liquidity) / itr->total_supply;
+    check(amount0 >= min_amount0 && amount1 >= min_amount1, "tokens did not meet expectations");
+
+    const extended_asset out0 = { asset(amount0, itr->reserve0.quantity.symbol), itr->reserve0.contract };
+    const extended_asset out1 = { asset(amount1, itr->reserve1.quantity.symbol), itr->reserve1.contract };
+    if (itr->total_supply == liquidity) {
+        // the last liquidity takes both reserves,the next addliquidity creates the pair again
+        pt.erase(itr);
+    } else {
+        pt.modify(itr, same_payer, [&](auto& m) {
+            m.reserve0.quantity.amount -= amount0;
+            m.reserve1.quantity.amount -= amount1;
+            m.total_supply -= liquidity;
+        });
+    }
+
+    if (amount0 > 0)
+        _add_deposit(user, out0.contract, out0.quantity);
+    if (amount1 > 0)
+        _add_deposit(user, out1.contract, out1.quantity);
+}
+
+ACTION dsswap::withdraw(const name& user, const name& contract, const asset& quantity) {
+    require_auth(user);
+    check(quantity.is_valid() && quantity.amount > 0, "invalid asset quantity");
+
+    _sub_deposit(user, contract, quantity);
+    _transfer_action(contract, user, quantity, "withdraw");
+}
+
+ACTION dsswap::prunevol(const uint64_t& epoch, const uint64_t& max_rows) {
+    check(max_rows > 0, "invalid max_rows value");
+    const uint64_t current = current_time_point().sec_since_epoch() / TRADE_EPOCH_SECS;
+    check(epoch + TRADE_CLAIM_EPOCHS < current, "epoch can still be claimed");
+
+    tradevol_idx tv(get_self(), epoch);
+    auto itr = tv.begin();
+    uint64_t erased = 0;
+    while (itr != tv.end() && erased < max_rows) {
+        itr = tv.erase(itr);
+        erased++;
+    }
+
+    if (itr == tv.end()) {
+        epochvol_idx ev(get_self(), get_self().value);
+        auto eitr = ev.find(epoch);
+        if (eitr != ev.end())
+            ev.erase(eitr);
+    }
+}
+
 ACTION dsswap::mtransfer(const name& contract, const structs::trx_tb& tx) {
     if (tx.from == get_self() || tx.to != get_self())
         return;
     if (tx.memo.empty())
         return;
 
-    vector<string> vec;
-    _split_memo(vec, tx.memo, ',');
-    const string act = _split_val(vec, "action");
+    const memo::fields f(tx.memo);
+    string_view act;
+    check(f.get("action", act), "parse memo error");
 
     if (act == "create_pair") {
         _check_eos(contract, tx.quantity);
-        _create_pair(tx, vec);
+        _create_pair(tx, f);
     } else if (act == "add_liquidity") {
         _check_eos(contract, tx.quantity);
-        _add_liquidity(tx, vec);
+        _add_liquidity(tx, f);
     } else if (act == "remove_liquidity") {
-        _remove_liquidity(contract, tx, vec);
+        _remove_liquidity(contract, tx, f);
     } else if (act == "eos_to_token") {
         _check_eos(contract, tx.quantity);
-        _eos_to_token(tx, vec);
+        _eos_to_token(tx, f);
     } else if (act == "token_to_eos") {
-        _token_to_eos(contract, tx, vec);
+        _token_to_eos(contract, tx, f);
     } else if (act == "token_to_token") {
-        _token_to_token(contract, tx, vec);
+        _token_to_token(contract, tx, f);
+    } else if (act == "route") {
+        _route_memo(contract, tx, f);
     } else if (act == "approve") {
         _approve(contract, tx);
     } else if (act == "cancel_approve") {
-        _cancel_approve(contract, tx, vec);
+        _cancel_approve(contract, tx, f);
+    } else if (act == "deposit") {
+        _deposit(contract, tx);
     } else if (act == "apply") {
         _check_eos(contract, tx.quantity);
-        _apply_add_token(tx, vec);
+        _apply_add_token(tx, f);
     }
 }
 
-void dsswap::_create_pair(const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
-    const uint64_t max_tokens = stoll(_split_val(vec, "max_tokens"));
+void dsswap::_create_pair(const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t max_tokens = _memo_u64(f, "max_tokens");
 
     check(max_tokens > 0, "invalid max_tokens");
     check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
@@ -108,11 +321,11 @@ void dsswap::_create_pair(const structs::trx_tb& tx, vector<string> vec) {
     });
 }
 
-void dsswap::_add_liquidity(const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
-    const uint64_t min_liquidity = stoll(_split_val(vec, "min_liquidity"));
-    const uint64_t max_tokens = stoll(_split_val(vec, "max_tokens"));
+void dsswap::_add_liquidity(const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t min_liquidity = _memo_u64(f, "min_liquidity");
+    const uint64_t max_tokens = _memo_u64(f, "max_tokens");
 
     check(min_liquidity > 0, "invalid min_liquidity");
     check(max_tokens > 0, "invalid max_tokens");
@@ -154,12 +367,12 @@ void dsswap::_add_liquidity(const structs::trx_tb& tx, vector<string> vec) {
     });
 }
 
-void dsswap::_remove_liquidity(const name& contract, const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
-    const uint64_t amount = stoll(_split_val(vec, "amount"));
-    const uint64_t min_eos = stoll(_split_val(vec, "min_eos"));
-    const uint64_t min_tokens = stoll(_split_val(vec, "min_tokens"));
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
+void dsswap::_remove_liquidity(const name& contract, const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
+    const uint64_t amount = _memo_u64(f, "amount");
+    const uint64_t min_eos = _memo_u64(f, "min_eos");
+    const uint64_t min_tokens = _memo_u64(f, "min_tokens");
+    const uint64_t deadline = _memo_u64(f, "deadline");
 
     check(amount > 0, "invalid amount");
     check(min_eos > 0, "invalid min_eos");
@@ -199,99 +412,196 @@ void dsswap::_remove_liquidity(const name& contract, const structs::trx_tb& tx,
     _transfer_action(contract, tx.from, tx.quantity, "returns");
 }
 
-void dsswap::_eos_to_token(const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
-    const uint64_t min_tokens = stoll(_split_val(vec, "min_tokens"));
+void dsswap::_eos_to_token(const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t min_tokens = _memo_u64(f, "min_tokens");
 
-    check(min_tokens > 0, "invalid min_tokens");
     check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
 
-    tokens tk = _get_token(token_contract);
-    const asset token_reserve = tk.token_balance;
-    const uint64_t tokens_bought = _get_input_price(tx.quantity.amount, tk.eos_balance.amount, token_reserve.amount);
-    check(tokens_bought >= min_tokens, "tokens did not meet expectations");
-
-    const asset tokens_bought_asset = asset(tokens_bought, tk.token_balance.symbol);
+    const asset tokens_bought = _buy_token(token_contract, tx.quantity, min_tokens);
+    _add_volume(tx.from, tx.quantity.amount);
+    _transfer_action(token_contract, tx.from, tokens_bought, "eos to token");
+}
 
-    token_idx tt(get_self(), get_self().value);
-    auto itr = tt.find(token_contract.value);
-    check(itr->token_balance >= tokens_bought_asset, "eos to token overdrawn balance");
+void dsswap::_token_to_eos(const name& contract, const structs::trx_tb& tx, const memo::fields& f) {
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t min_eos = _memo_u64(f, "min_eos");
 
-    tt.modify(itr, same_payer, [&](auto& m) {
-        m.token_balance -= tokens_bought_asset;
-        m.eos_balance += tx.quantity;
-    });
+    check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
 
-    _transfer_action(token_contract, tx.from, tokens_bought_asset, "eos to token");
+    const asset eos_bought = _sell_token(contract, tx.quantity, min_eos);
+    _add_volume(tx.from, eos_bought.amount);
+    _transfer_action(EOS_CONTRACT, tx.from, eos_bought, "token to eos");
 }
 
-void dsswap::_token_to_eos(const name& contract, const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = contract;
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
-    const uint64_t min_eos = stoll(_split_val(vec, "min_eos"));
-    const asset tokens_sold = tx.quantity;
+void dsswap::_token_to_token(const name& contract, const structs::trx_tb& tx, const memo::fields& f) {
+    const name sold_contract = contract;
+    const name bought_contract = _memo_name(f, "token_contract"); // The contract of the token being purchased.
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t min_tokens_bought = _memo_u64(f, "min_tokens_bought");
+    const uint64_t min_eos_bought = _memo_u64(f, "min_eos_bought");
 
-    check(min_eos > 0, "invalid min_eos");
     check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
+    check(sold_contract != bought_contract, "must be different than sold token contract");
 
-    tokens tk = _get_token(token_contract);
-    _check_asset(tokens_sold, tk.token_balance.symbol);
+    const asset eos_bought = _sell_token(sold_contract, tx.quantity, min_eos_bought);
+    const asset tokens_bought = _buy_token(bought_contract, eos_bought, min_tokens_bought);
 
-    const uint64_t token_reserve = tk.token_balance.amount;
-    const uint64_t eos_bought = _get_input_price(tokens_sold.amount, token_reserve, tk.eos_balance.amount);
-    check(eos_bought >= min_eos, "eos did not meet expectations");
+    // the EOS leg is counted once
+    _add_volume(tx.from, eos_bought.amount);
+    _transfer_action(bought_contract, tx.from, tokens_bought, "eos to token");
+}
+
+void dsswap::_route_memo(const name& contract, const structs::trx_tb& tx, const memo::fields& f) {
+    const uint64_t deadline = _memo_u64(f, "deadline");
+    const uint64_t min_out = _memo_u64(f, "min_out");
+    check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
+
+    string_view path_val;
+    check(f.get("path", path_val), "parse memo error");
+    array<string_view, MAX_ROUTE_HOPS> parts;
+    size_t count;
+    check(memo::split(path_val, '-', parts, count), "too many hops");
+
+    vector<name> path(count);
+    for (size_t i = 0; i < count; i++)
+        check(memo::parse_name(parts[i], path[i]), "parse memo error");
+
+    const asset out = _route(tx.from, contract, tx.quantity, path, min_out);
+    _transfer_action(path.back(), tx.from, out, "route");
+}
+
+asset dsswap::_route(const name& trader, const name& contract, const asset& amount_in, const vector<name>& path, const uint64_t& min_out) {
+    check(path.size() > 0 && path.size() <= MAX_ROUTE_HOPS, "invalid path");
+    check(min_out > 0, "invalid min_out");
+
+    // slippage is checked on the final output only
+    name cur = contract;
+    asset amount = amount_in;
+    uint64_t volume = 0;
+    for (const auto& next : path) {
+        check(next != cur, "invalid path");
+        if (volume == 0 && cur == EOS_CONTRACT)
+            volume = amount.amount;
+        amount = _hop(cur, amount, next);
+        if (volume == 0 && next == EOS_CONTRACT)
+            volume = amount.amount;
+        cur = next;
+    }
+    check(amount.amount >= min_out, "tokens did not meet expectations");
+
+    // the EOS leg is counted once per route,direct TOKEN/TOKEN hops have none
+    if (volume > 0)
+        _add_volume(trader, volume);
+    return amount;
+}
+
+asset dsswap::_hop(const name& contract, const asset& amount, const name& next) {
+    // a direct TOKEN/TOKEN pair first,then the TOKEN/EOS pair
+    // EOS hops always use the canonical pool
+    asset out;
+    if (contract != EOS_CONTRACT && next != EOS_CONTRACT && _swap_pair(contract, amount, next, out))
+        return out;
+
+    if (contract == EOS_CONTRACT) {
+        _check_asset_eos(amount);
+        return _buy_token(next, amount, 1);
+    }
+    check(next == EOS_CONTRACT, "pair does not exist");
+    return _sell_token(contract, amount, 1);
+}
+
+bool dsswap::_swap_pair(const name& contract, const asset& amount_in, const name& out_contract, asset& out) {
+    pair_idx pt(get_self(), get_self().value);
+    auto idx = pt.get_index<name("bycontracts")>();
+    const uint128_t key = contracts_key(contract, out_contract);
+    for (auto itr = idx.lower_bound(key); itr != idx.end() && itr->by_contracts() == key; itr++) {
+        const bool zero_in = itr->reserve0.contract == contract && itr->reserve0.quantity.symbol == amount_in.symbol &&
+                             itr->reserve1.contract == out_contract;
+        const bool one_in = itr->reserve1.contract == contract && itr->reserve1.quantity.symbol == amount_in.symbol &&
+                            itr->reserve0.contract == out_contract;
+        if (!zero_in && !one_in)
+            continue;
+
+        const asset& reserve_in = zero_in ? itr->reserve0.quantity : itr->reserve1.quantity;
+        const asset& reserve_out = zero_in ? itr->reserve1.quantity : itr->reserve0.quantity;
+        const uint64_t bought = _get_input_price(amount_in.amount, reserve_in.amount, reserve_out.amount);
+        check(bought > 0 && bought < reserve_out.amount, "pair overdrawn balance");
+
+        out = asset(bought, reserve_out.symbol);
+        idx.modify(itr, same_payer, [&](auto& m) {
+            auto& in_side = zero_in ? m.reserve0 : m.reserve1;
+            auto& out_side = zero_in ? m.reserve1 : m.reserve0;
+            in_side.quantity.amount = safemath::add(in_side.quantity.amount, amount_in.amount);
+            out_side.quantity.amount -= bought;
+        });
+        return true;
+    }
+    return false;
+}
+
+void dsswap::_check_pair_token(const extended_asset& quantity) {
+    check(quantity.quantity.is_valid() && quantity.quantity.amount > 0, "invalid asset quantity");
+    // EOS pools live in `tokens`,a second EOS pool could take over the routed EOS hops
+    check(quantity.contract != EOS_CONTRACT, "EOS is not a pair token");
+    tokens tk = _get_token(quantity.contract);
+    _check_asset(quantity.quantity, tk.token_balance.symbol);
+}
+
+void dsswap::_add_pair_mint(const uint64_t& pair_id, const name& account, const uint64_t& amount) {
+    pairmint_idx mt(get_self(), pair_id);
+    auto itr = mt.find(account.value);
+    if (itr == mt.end()) {
+        mt.emplace(get_self(), [&](auto& m) {
+            m.account = account;
+            m.amount = amount;
+        });
+    } else {
+        mt.modify(itr, same_payer, [&](auto& m) {
+            m.amount = safemath::add(m.amount, amount);
+        });
+    }
+}
+
+asset dsswap::_buy_token(const name& token_contract, const asset& eos_quantity, const uint64_t& min_tokens) {
+    check(min_tokens > 0, "invalid min_tokens");
 
     token_idx tt(get_self(), get_self().value);
     auto itr = tt.find(token_contract.value);
-    check(itr->eos_balance.amount >= eos_bought, "token to eos overdrawn balance");
+    check(itr != tt.end(), "token contract does not register");
+
+    const uint64_t tokens_bought = _get_input_price(eos_quantity.amount, itr->eos_balance.amount, itr->token_balance.amount);
+    check(tokens_bought >= min_tokens, "tokens did not meet expectations");
+
+    const asset tokens_bought_asset = asset(tokens_bought, itr->token_balance.symbol);
+    check(itr->token_balance >= tokens_bought_asset, "eos to token overdrawn balance");
 
-    const asset eos_bought_asset = asset(eos_bought, EOS_SYMBOL);
     tt.modify(itr, same_payer, [&](auto& m) {
-        m.token_balance += tokens_sold;
-        m.eos_balance -= eos_bought_asset;
+        m.token_balance -= tokens_bought_asset;
+        m.eos_balance += eos_quantity;
     });
-
-    _transfer_action(EOS_CONTRACT, tx.from, eos_bought_asset, "token to eos");
+    return tokens_bought_asset;
 }
 
-void dsswap::_token_to_token(const name& contract, const structs::trx_tb& tx, vector<string> vec) {
-    const name sold_contract = contract;
-    const asset tokens_sold = tx.quantity;
-    const name bought_contract = name(_split_val(vec, "token_contract")); // The contract of the token being purchased.
-    const uint64_t deadline = stoll(_split_val(vec, "deadline"));
-    const string min_tokens_bought = _split_val(vec, "min_tokens_bought");
-    const uint64_t min_eos_bought = stoll(_split_val(vec, "min_eos_bought"));
-
-    check(min_eos_bought > 0, "invalid min_eos_bought");
-    check(deadline > current_time_point().sec_since_epoch(), "deadline is up");
-    check(sold_contract != bought_contract, "must be different than sold token contract");
+asset dsswap::_sell_token(const name& token_contract, const asset& tokens_sold, const uint64_t& min_eos) {
+    check(min_eos > 0, "invalid min_eos");
 
-    tokens sold_tk = _get_token(sold_contract);
-    _check_asset(tokens_sold, sold_tk.token_balance.symbol);
+    token_idx tt(get_self(), get_self().value);
+    auto itr = tt.find(token_contract.value);
+    check(itr != tt.end(), "token contract does not register");
+    _check_asset(tokens_sold, itr->token_balance.symbol);
 
-    const uint64_t token_reserve = sold_tk.token_balance.amount;
-    const uint64_t eos_bought = _get_input_price(tokens_sold.amount, token_reserve, sold_tk.eos_balance.amount);
-    check(eos_bought >= min_eos_bought, "eos did not meet expectations");
+    const uint64_t eos_bought = _get_input_price(tokens_sold.amount, itr->token_balance.amount, itr->eos_balance.amount);
+    check(eos_bought >= min_eos, "eos did not meet expectations");
+    check(itr->eos_balance.amount >= eos_bought, "token to eos overdrawn balance");
 
     const asset eos_bought_asset = asset(eos_bought, EOS_SYMBOL);
-    token_idx tt(get_self(), get_self().value);
-    auto itr = tt.find(sold_contract.value);
     tt.modify(itr, same_payer, [&](auto& m) {
         m.token_balance += tokens_sold;
         m.eos_balance -= eos_bought_asset;
     });
-
-    structs::trx_tb req_tx = { .from = tx.from,
-                               .to = bought_contract,
-                               .quantity = eos_bought_asset,
-                               string("") };
-    vector<string> req_vec;
-    req_vec.emplace_back(_split_val(vec, "token_contract", true));
-    req_vec.emplace_back(_split_val(vec, "deadline", true));
-    req_vec.emplace_back(string("min_tokens:") + min_tokens_bought);
-
-    _eos_to_token(req_tx, req_vec);
+    return eos_bought_asset;
 }
 
 void dsswap::_approve(const name& contract, const structs::trx_tb& tx) {
@@ -314,8 +624,8 @@ void dsswap::_approve(const name& contract, const structs::trx_tb& tx) {
     }
 }
 
-void dsswap::_cancel_approve(const name& contract, const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
+void dsswap::_cancel_approve(const name& contract, const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
 
     allow_idx atb(get_self(), token_contract.value);
     auto itr = atb.find(tx.from.value);
@@ -330,9 +640,10 @@ void dsswap::_cancel_approve(const name& contract, const structs::trx_tb& tx, ve
     _transfer_action(contract, tx.from, tx.quantity, "returns");
 }
 
-void dsswap::_apply_add_token(const structs::trx_tb& tx, vector<string> vec) {
-    const name token_contract = name(_split_val(vec, "token_contract"));
-    const symbol_code code = symbol_code(_split_val(vec, "symbol_code"));
+void dsswap::_apply_add_token(const structs::trx_tb& tx, const memo::fields& f) {
+    const name token_contract = _memo_name(f, "token_contract");
+    symbol_code code;
+    check(f.get_symbol_code("symbol_code", code), "parse memo error");
 
     check(tx.quantity.amount == 100 * 10000, "100 EOS required");
     check(is_account(token_contract), "token_contract does not exist");
@@ -355,6 +666,46 @@ void dsswap::_apply_add_token(const structs::trx_tb& tx, vector<string> vec) {
     });
 }
 
+void dsswap::_deposit(const name& contract, const structs::trx_tb& tx) {
+    if (contract == EOS_CONTRACT) {
+        _check_asset_eos(tx.quantity);
+    } else {
+        tokens tk = _get_token(contract);
+        _check_asset(tx.quantity, tk.token_balance.symbol);
+    }
+    _add_deposit(tx.from, contract, tx.quantity);
+}
+
+void dsswap::_add_deposit(const name& owner, const name& contract, const asset& quantity) {
+    deposit_idx dt(get_self(), owner.value);
+    auto itr = dt.find(contract.value);
+    if (itr == dt.end()) {
+        dt.emplace(get_self(), [&](auto& m) {
+            m.contract = contract;
+            m.balance = quantity;
+        });
+    } else {
+        dt.modify(itr, same_payer, [&](auto& m) {
+            m.balance += quantity;
+        });
+    }
+}
+
+void dsswap::_sub_deposit(const name& owner, const name& contract, const asset& quantity) {
+    deposit_idx dt(get_self(), owner.value);
+    auto itr = dt.find(contract.value);
+    check(itr != dt.end() && itr->balance.symbol == quantity.symbol, "deposit does not exist");
+    check(itr->balance.amount >= quantity.amount, "overdrawn deposit balance");
+
+    if (itr->balance.amount == quantity.amount) {
+        dt.erase(itr);
+    } else {
+        dt.modify(itr, same_payer, [&](auto& m) {
+            m.balance -= quantity;
+        });
+    }
+}
+
 void dsswap::_check_eos(const name& contract, const asset& quantity) {
     check(contract == EOS_CONTRACT, "eosio.token only");
     _check_asset_eos(quantity);
@@ -368,41 +719,16 @@ void dsswap::_check_asset(const asset& quantity, const symbol& symbol) {
     check(quantity.is_valid() && quantity.amount > 0 && quantity.symbol == symbol, "invalid asset quantity");
 }
 
-void dsswap::_split_memo(vector<string>& results, string memo, char separator) {
-    results.clear();
-    auto start_inx = memo.cbegin();
-    auto end_inx = memo.cend();
-    bool is_empty_str_last = false;
-    size_t len = memo.size();
-    size_t index = 0;
-    for (auto it = start_inx; it != end_inx; ++it) {
-        if (*it == separator) {
-            results.emplace_back(start_inx, it);
-            start_inx = it + 1;
-            is_empty_str_last = index == len - 1;
-        }
-        index++;
-    }
-    if (start_inx != end_inx)
-        results.emplace_back(start_inx, end_inx);
-    if (is_empty_str_last)
-        results.emplace_back(std::string(""));
-}
-
-string dsswap::_split_val(const vector<string>& kv_vec, string k) {
-    return _split_val(kv_vec, k, false);
+uint64_t dsswap::_memo_u64(const memo::fields& f, const string_view& key) {
+    uint64_t value;
+    check(f.get_u64(key, value), "parse memo error");
+    return value;
 }
 
-string dsswap::_split_val(const vector<string>& kv_vec, string k, bool kv) {
-    vector<string> vec;
-    for (size_t i = 0; i < kv_vec.size(); i++) {
-        _split_memo(vec, kv_vec[i], ':');
-        if (vec[0] == k) {
-            return kv ? kv_vec[i] : vec[1];
-        }
-    }
-    check(false, "parse memo error");
-    return "";
+name dsswap::_memo_name(const memo::fields& f, const string_view& key) {
+    name value;
+    check(f.get_name(key, value), "parse memo error");
+    return value;
 }
 
 dsswap::tokens dsswap::_get_token(const name& contract) {
@@ -412,6 +738,36 @@ dsswap::tokens dsswap::_get_token(const name& contract) {
     return *itr;
 }
 
+void dsswap::_add_volume(const name& account, const uint64_t& eos_amount) {
+    const uint64_t epoch = current_time_point().sec_since_epoch() / TRADE_EPOCH_SECS;
+
+    tradevol_idx tv(get_self(), epoch);
+    auto itr = tv.find(account.value);
+    if (itr == tv.end()) {
+        tv.emplace(get_self(), [&](auto& m) {
+            m.account = account;
+            m.volume = eos_amount;
+        });
+    } else {
+        tv.modify(itr, same_payer, [&](auto& m) {
+            m.volume = safemath::add(m.volume, eos_amount);
+        });
+    }
+
+    epochvol_idx ev(get_self(), get_self().value);
+    auto eitr = ev.find(epoch);
+    if (eitr == ev.end()) {
+        ev.emplace(get_self(), [&](auto& m) {
+            m.epoch = epoch;
+            m.volume = eos_amount;
+        });
+    } else {
+        ev.modify(eitr, same_payer, [&](auto& m) {
+            m.volume = safemath::add(m.volume, eos_amount);
+        });
+    }
+}
+
 uint64_t dsswap::_get_input_price(const uint64_t& input_amount, const uint64_t& input_reserve, const uint64_t& output_reserve) {
     check(input_reserve > 0 && output_reserve > 0, "invalid input amount or reserve");
     const uint64_t input_amount_with_fee = safemath::mul(input_amount, 997);